@@ -21,6 +21,7 @@
 import sys
 import fileinput
 import math
+from NBResults import readNBResults
 
 if len(sys.argv) != 4:
 	print 'Epsilon-NB v1.0 by Donovan Parks, Norm MacDonald, and Rob Beiko'
@@ -57,34 +58,23 @@ for line in  fileinput.input(['taxonomy.txt']):
 # calculate epsilon-NB classification
 print 'Calculating epsilon-NB classification for each fragment...'
 topTaxonomies = {}
-bHeaderLine = True
-strains = []
-for line in fileinput.input([nbResults]):
-	lineSplit = line.split('\t')
-	
-	if bHeaderLine:
-		for i in xrange(3, len(lineSplit)):
-			strains.append(lineSplit[i].strip())
-		bHeaderLine = False
-		continue
-	
-	fragmentId = lineSplit[0]
-
+strains, fragments = readNBResults(nbResults)
+for fragmentId, logLikelihoods in fragments:
 	# find maximum likelihood model
 	topModel = ''
 	topLogLikelihood = -1e100
-	for i in xrange(3, len(lineSplit)):
-		if float(lineSplit[i]) > topLogLikelihood:
-			topModel = strains[i-3]
-			topLogLikelihood = float(lineSplit[i])
+	for i in xrange(0, len(logLikelihoods)):
+		if logLikelihoods[i] > topLogLikelihood:
+			topModel = strains[i]
+			topLogLikelihood = logLikelihoods[i]
 	
 	# find all NB models within a given distance of the maximum likelihood model
 	topTaxonomy = list(strainToTaxonomy[topModel])
-	for i in xrange(3, len(lineSplit)):
-		logLikelihood = float(lineSplit[i])
+	for i in xrange(0, len(logLikelihoods)):
+		logLikelihood = logLikelihoods[i]
 
 		if epsilon + logLikelihood >= topLogLikelihood:
-			t = strainToTaxonomy[strains[i-3]]
+			t = strainToTaxonomy[strains[i]]
 			
 			for r in xrange(0, 8):
 				if topTaxonomy[r] != t[r]:
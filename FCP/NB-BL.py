@@ -23,6 +23,7 @@ TAXONOMY_TXT = 'taxonomy.txt'
 import sys
 import fileinput
 import math
+from NBResults import readNBResults
 
 if len(sys.argv) != 4:
 	print 'NB-BL v1.2 by Donovan Parks, Norm MacDonald, and Rob Beiko'
@@ -194,14 +195,13 @@ fout.write('Fragment Id\tTaxonomic classification\n')
 # nbLogLikelihoods is a dictionary containing the LogLikelihood
 # of each query sequence being each given strain for all strains
 nbLogLikelihoods = {}
-bHeaderLine = True
-strains = []
 
 # Format of NB file is
 #	FragmentID	Length	Valid_n-mers	Species1	Species2 ... SpeciesN
-#	Each fragment uses one line with the scores for all tested species
+#	Each fragment uses one line with the scores for all tested species.
+#	Results written with --format float32 or float16 are read directly.
 try:
-	nb = open(nbResults, "r")
+	strains, fragments = readNBResults(nbResults)
 except:
 	print "Cannot open", nbResults
 
@@ -220,26 +220,12 @@ except:
 #	That should be easy to do with a grep(1)/sort(1) combination. We
 #	could get rid of comments in blast since we need not worry about
 #	them.
-for line in nb:
-	lineSplit = line.split('\t')
-	
-	# The first line is special: it contains the header
-	#	with the names of all tested species (from column 4 [3] on)
-	# Retrieve the name of all the species tested by NB
-	if bHeaderLine:
-		for i in xrange(3, len(lineSplit)):
-			strains.append(lineSplit[i].strip())
-		bHeaderLine = False
-		continue
-	
-	# we expect each line to correspond to a different fragmentId
-	fragmentId = lineSplit[0]
-	
-	# obtain likelihoods (they are all in the same line)
+for fragmentId, scores in fragments:
+	# obtain likelihoods of each species tested by NB
 	logLikelihoods = {}
-	for i in xrange(3, len(lineSplit)):
-		strain = strains[i-3]
-		logLikelihoods[strain] = float(lineSplit[i])
+	for i in xrange(0, len(scores)):
+		strain = strains[i]
+		logLikelihoods[strain] = scores[i]
 		# the following could be added here as well saving loops
 		
 	# Combine with NB-BL to obtain actual scores
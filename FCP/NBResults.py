@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+###############################################################################
+#                                                                             #
+#    This program is free software: you can redistribute it and/or modify     #
+#    it under the terms of the GNU General Public License as published by     #
+#    the Free Software Foundation, either version 3 of the License, or        #
+#    (at your option) any later version.                                      #
+#                                                                             #
+#    This program is distributed in the hope that it will be useful,          #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of           #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            #
+#    GNU General Public License for more details.                             #
+#                                                                             #
+#    You should have received a copy of the GNU General Public License        #
+#    along with this program. If not, see <http://www.gnu.org/licenses/>.     #
+#                                                                             #
+###############################################################################
+
+# Read results of the NB classifier with T=0 written as text or in the binary
+# formats of nb-classify (--format float32 or float16).
+
+import sys
+import mmap
+import struct
+import array
+
+BINARY_MAGIC = b'NBRB'
+FLOAT16_SCORES = 1
+
+# float value of every IEEE half precision bit pattern
+halfValues = None
+
+def buildHalfValues():
+	values = []
+	for bits in range(0, 65536):
+		sign = -1.0 if bits & 0x8000 else 1.0
+		exponent = (bits >> 10) & 0x1F
+		mantissa = bits & 0x3FF
+		if exponent == 0:
+			values.append(sign * mantissa * 2.0**-24)
+		elif exponent == 31:
+			values.append(sign * float('inf') if mantissa == 0 else float('nan'))
+		else:
+			values.append(sign * (1.0 + mantissa / 1024.0) * 2.0**(exponent - 15))
+	return values
+
+def isBinaryResults(filename):
+	f = open(filename, 'rb')
+	magic = f.read(4)
+	f.close()
+	return magic == BINARY_MAGIC
+
+def readText(filename):
+	strains = []
+	f = open(filename, 'r')
+	header = f.readline().rstrip('\n').split('\t')
+	for i in range(3, len(header)):
+		strains.append(header[i].strip())
+
+	def fragments():
+		for line in f:
+			lineSplit = line.rstrip('\n').split('\t')
+			yield lineSplit[0], [float(x) for x in lineSplit[3:]]
+		f.close()
+
+	return strains, fragments()
+
+def readBinary(filename):
+	global halfValues
+
+	f = open(filename, 'rb')
+	data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+	version, scoreFormat, numModels = struct.unpack_from('<III', data, 4)
+	pos = 16
+	strains = []
+	taxonomies = []
+	for m in range(0, numModels):
+		size = struct.unpack_from('<I', data, pos)[0]
+		strains.append(str(data[pos+4:pos+4+size].decode('ascii')))
+		pos += 4 + size
+		size = struct.unpack_from('<I', data, pos)[0]
+		taxonomies.append(str(data[pos+4:pos+4+size].decode('ascii')))
+		pos += 4 + size
+	pos = (pos + 7) & ~7
+
+	if scoreFormat == FLOAT16_SCORES and halfValues == None:
+		halfValues = buildHalfValues()
+
+	def fragments():
+		blockStart = pos
+		while blockStart < len(data):
+			blockSize, numFragments, idBytes = struct.unpack_from('<QII', data, blockStart)
+			p = blockStart + 16
+			ids = str(data[p:p+idBytes].decode('ascii')).split('\0')
+			p += (idBytes + 7) & ~7
+
+			# lengths and valid n-mers are not needed for classification
+			p += 8 * numFragments
+			bestLogLikelihoods = array.array('f', data[p:p + 4*numFragments])
+			p += 4 * numFragments
+
+			scoreBytes = 2 if scoreFormat == FLOAT16_SCORES else 4
+			for i in range(0, numFragments):
+				row = data[p:p + scoreBytes*numModels]
+				p += scoreBytes * numModels
+				if scoreFormat == FLOAT16_SCORES:
+					best = bestLogLikelihoods[i]
+					yield ids[i], [best + halfValues[h] for h in array.array('H', row)]
+				else:
+					yield ids[i], array.array('f', row).tolist()
+
+			blockStart += blockSize
+		data.close()
+		f.close()
+
+	return strains, fragments()
+
+# Returns the name of each model and an iterator over the fragment id and
+# list of log likelihoods (one per model) of each fragment.
+def readNBResults(filename):
+	if isBinaryResults(filename):
+		return readBinary(filename)
+
+	return readText(filename)
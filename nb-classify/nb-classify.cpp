@@ -21,16 +21,30 @@
 
 #include "stdafx.h"
 
+#include <random>
+
+#include "BinaryResults.hpp"
+#include "DeltaIndex.hpp"
+#include "ExactKmerIndex.hpp"
 #include "FastaIO.hpp"
+#include "FragmentTable.hpp"
+#include "FragmentWindows.hpp"
 #include "KmerCalculator.hpp"
 #include "KmerModel.hpp"
+#include "KmerProfileArena.hpp"
+#include "LowRankModel.hpp"
+#include "ModelBlock.hpp"
+#include "ScoringKernels.hpp"
+#include "SketchIndex.hpp"
 #include "Utils.hpp"
 
 struct Parameters
 {
-	bool bShowHelp, bShowVersion, bShowContactInfo;
-	std::string queryFile, modelFile, resultsFile, tempExtension;
-	int batchSize, topModels, verbose;
+	bool bShowHelp, bShowVersion, bShowContactInfo, bCompactKmers, bBlocked, bInterleaved;
+	std::string queryFile, mateFile, modelFile, resultsFile, resultsFormat, nullModelFile, lowRankFile, prefilterModelFile, exactIndexFile, sketchFile, clusterFile, skippedPairsFile;
+	int batchSize, topModels, verbose, groupSize, fusedTileSize, rescoreCandidates, numThreads, minSketchLength, expandedClusters, windowLength, windowStep;
+	float candidateMargin, gcTailProbability, eliminationMargin;
+	SCORING_KERNEL scoringKernel;
 };
 
 void help()
@@ -40,9 +54,9 @@ void help()
 	std::cout << "  Usage: [options] -q <query-file> -m <model-file> -r <results-file>" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Required parameters:" << std::endl;
-	std::cout << "  <query-file>    Multi-FASTA file containing query fragments to classify." << std::endl;
+	std::cout << "  <query-file>    Multi-FASTA file containing query fragments to classify (- for stdin)." << std::endl;
 	std::cout << "  <model-file>    File indicating models to use for classification." << std::endl;
-	std::cout << "  <results-file>  File to write classification results to." << std::endl;
+	std::cout << "  <results-file>  File to write classification results to (- for stdout)." << std::endl;
 	std::cout << std::endl;
 	std::cout << "Optional parameters:" << std::endl;
 	std::cout << "  --help        Print help message." << std::endl;
@@ -53,10 +67,106 @@ void help()
 	std::cout << "                  wish to have the log likelihood of all models in the" << std::endl;
 	std::cout << "                  results file set T = 0 (default = 0)." << std::endl;
 	std::cout << "  -v <integer>  Level of output information (default = 1)." << std::endl;	
-	std::cout << "  -e <string>   Extension to add to temporary files (default = txt)." << std::endl;	
+	std::cout << "  -g, --interleave <integer>  Number of fragments whose n-mer lookups are interleaved when" << std::endl;
+	std::cout << "                  applying each model. Interleaved scoring gives results identical to the" << std::endl;
+	std::cout << "                  scalar instruction set (default = 1, no interleaving)." << std::endl;
+	std::cout << "  -c, --collapse      Collapse repeated n-mers within each fragment before scoring. Useful for" << std::endl;
+	std::cout << "                  long reads and contigs. Repeated n-mers are weighted by their count so" << std::endl;
+	std::cout << "                  results may differ from earlier versions in the last digits." << std::endl;
+	std::cout << "  -f, --fused <integer>  Calculate n-mers while applying tiles of the given number of models" << std::endl;
+	std::cout << "                  instead of storing the n-mers of each fragment. Best when a tile of models" << std::endl;
+	std::cout << "                  fits in cache. At most 8 models are applied at once. Results are identical" << std::endl;
+	std::cout << "                  to the scalar instruction set (default = 0, n-mers are stored)." << std::endl;
+	std::cout << "  -s, --blocked       Apply blocks of 16 models at once as a sparse n-mer count times dense" << std::endl;
+	std::cout << "                  model matrix product. Results are identical to the scalar instruction set." << std::endl;
+	std::cout << "  -p, --threads <integer>  Number of threads used to apply each block of models with -s" << std::endl;
+	std::cout << "                  (default = 1)." << std::endl;
+	std::cout << "  -n, --null-model <file>  Null model the delta models were trained against (see nb-train" << std::endl;
+	std::cout << "                  --null-model). Required for delta models, which give approximate log" << std::endl;
+	std::cout << "                  likelihoods." << std::endl;
+	std::cout << "  -l, --low-rank <file>  Low-rank approximation of the models built with nb-compress. Log" << std::endl;
+	std::cout << "                  likelihoods of all models are approximated from a projection of each" << std::endl;
+	std::cout << "                  fragment onto a small number of basis tables." << std::endl;
+	std::cout << "  -a, --prefilter <file>  File indicating low n-mer length prefilter models (see nb-train" << std::endl;
+	std::cout << "                  --prefilter-length) listed in the same order as the models. All prefilter" << std::endl;
+	std::cout << "                  models are applied to each fragment and only the best candidates are" << std::endl;
+	std::cout << "                  re-scored with the models. Requires T > 0." << std::endl;
+	std::cout << "  -k, --exact-index <file>  Exact k-mer index of the models (see nb-train --exact-index). Only" << std::endl;
+	std::cout << "                  models sharing exact k-mers with a fragment are scored, with all models" << std::endl;
+	std::cout << "                  scored for fragments without any shared k-mers. Requires T > 0." << std::endl;
+	std::cout << "  --sketches <file>   FracMinHash sketches of the models (see nb-train --sketches). Fragments" << std::endl;
+	std::cout << "                  at least as long as set by -o are only scored with models whose sketch" << std::endl;
+	std::cout << "                  contains the most hashes of the fragment sketch. All models are scored for" << std::endl;
+	std::cout << "                  shorter fragments and fragments sharing no hashes with any model. Requires" << std::endl;
+	std::cout << "                  T > 0." << std::endl;
+	std::cout << "  -o, --sketch-min-length <integer>  Minimum length of fragments whose candidate models are" << std::endl;
+	std::cout << "                  selected with sketches (default = 5000)." << std::endl;
+	std::cout << "  -j, --clusters <file>  Cluster file of the models built with nb-cluster. The centroid model" << std::endl;
+	std::cout << "                  of each cluster is applied to each fragment and all members of the best" << std::endl;
+	std::cout << "                  clusters are scored. Requires T > 0." << std::endl;
+	std::cout << "  -z, --clusters-scored <integer>  Number of clusters whose members are scored for each" << std::endl;
+	std::cout << "                  fragment when -j is given (default = 3)." << std::endl;
+	std::cout << "  -x, --candidates <integer>  Number of models with the highest approximate log likelihood" << std::endl;
+	std::cout << "                  that are re-scored exactly for each fragment when -l or -a is given. With" << std::endl;
+	std::cout << "                  -l, other models report approximate log likelihoods. With -k or --sketches," << std::endl;
+	std::cout << "                  the number of models sharing the most k-mers with a fragment that are" << std::endl;
+	std::cout << "                  scored. Not used with -j, where the number of clusters set by -z decides" << std::endl;
+	std::cout << "                  how many models are scored (default = 10)." << std::endl;
+	std::cout << "  -y, --candidate-margin <float>  Also re-score all models with an approximate log likelihood" << std::endl;
+	std::cout << "                  within the given margin of the best model when -l or -a is given (default =" << std::endl;
+	std::cout << "                  no margin)." << std::endl;
+	std::cout << "  -w, --gc-tail <float>  Skip models for which the GC content of a fragment is implausible," << std::endl;
+	std::cout << "                  where the two-sided fraction of training windows (see nb-train --gc-window)" << std::endl;
+	std::cout << "                  with GC content at least as extreme is below the given tail probability." << std::endl;
+	std::cout << "                  Only fragments at least as long as the windows are tested, and fragments" << std::endl;
+	std::cout << "                  for which every model would be skipped are scored against all models." << std::endl;
+	std::cout << "                  Requires T > 0 (default = 0, no models skipped)." << std::endl;
+	std::cout << "  -u, --skipped-pairs <file>  File to write each skipped fragment and model to when -w is" << std::endl;
+	std::cout << "                  given." << std::endl;
+	std::cout << "  -d, --eliminate <float>  Visit the n-mers of each fragment in random order and stop scoring" << std::endl;
+	std::cout << "                  a model once its partial log likelihood trails that of the T-th best model" << std::endl;
+	std::cout << "                  over the same n-mers by more than the given margin times the square root" << std::endl;
+	std::cout << "                  of the number of n-mers visited. Eliminated models are not reported." << std::endl;
+	std::cout << "                  Requires T > 0 (default = models are not eliminated)." << std::endl;
+	std::cout << "  --format <string>   Format of results when T = 0: text, float32, or float16. The binary" << std::endl;
+	std::cout << "                  formats store scores as matrices that can be read without parsing. With" << std::endl;
+	std::cout << "                  float16, scores are differences from the best model (default = text)." << std::endl;
+	std::cout << "  --mates <file>      File of second mates of paired-end reads, in the same order as the first" << std::endl;
+	std::cout << "                  mates in the query file. Both mates of a pair are classified together and" << std::endl;
+	std::cout << "                  reported as one result named after the first mate without a /1 suffix." << std::endl;
+	std::cout << "  --interleaved       Query file holds paired-end reads with each first mate followed by its" << std::endl;
+	std::cout << "                  second mate (e.g., read1/1 followed by read1/2)." << std::endl;
+	std::cout << "  --window <integer>  Classify windows of the given length along each fragment, with one" << std::endl;
+	std::cout << "                  result per window identified as <fragment id>:<start>-<end> (default = 0," << std::endl;
+	std::cout << "                  fragments are classified whole)." << std::endl;
+	std::cout << "  --step <integer>    Distance between the starts of consecutive windows (default = half the" << std::endl;
+	std::cout << "                  window length)." << std::endl;
+	std::cout << "  -i, --instruction-set <string>  Instruction set used to score fragments: auto, scalar, sse2," << std::endl;
+	std::cout << "                  avx2, or avx512. The best supported by the CPU is used with auto. Vector" << std::endl;
+	std::cout << "                  instruction sets sum log probabilities in a different order, so log" << std::endl;
+	std::cout << "                  likelihoods of long fragments can differ from scalar by several log units." << std::endl;
+	std::cout << "                  The -g, -f, and -s options always give scalar results, so use scalar for" << std::endl;
+	std::cout << "                  output that is identical across CPUs and options (default = auto)." << std::endl;
 	std::cout << std::endl;
 	std::cout << "Typical usage:" << std::endl;
-	std::cout << "  nb-classify -q test.fasta -m models.txt -r nb_results.txt" << std::endl << std::endl;
+	std::cout << "  nb-classify -q test.fasta -m models.txt -r nb_results.txt" << std::endl;
+	std::cout << "  cat test.fasta | nb-classify -q - -m models.txt -r - > nb_results.txt" << std::endl << std::endl;
+}
+
+// true if the option at position p is followed by a value
+bool hasValue(int argc, char* argv[], int p)
+{
+	if(p + 1 < argc)
+		return true;
+
+	std::cout << "Missing value for parameter: " << argv[p] << std::endl << std::endl;
+	return false;
+}
+
+// true if the argument is the short or long name of an option
+bool isOption(const char* arg, const char* shortName, const char* longName)
+{
+	return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
 }
 
 bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
@@ -68,65 +178,1501 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 	parameters.batchSize = 50000;
 	parameters.topModels = 0;
 	parameters.verbose = 1;
-	parameters.tempExtension = "txt";
+	parameters.groupSize = 1;
+	parameters.bCompactKmers = false;
+	parameters.fusedTileSize = 0;
+	parameters.rescoreCandidates = 10;
+	parameters.minSketchLength = 5000;
+	parameters.expandedClusters = 3;
+	parameters.windowLength = 0;
+	parameters.bInterleaved = false;
+	parameters.resultsFormat = "text";
+	parameters.windowStep = 0;
+	parameters.candidateMargin = -1.0f;
+	parameters.eliminationMargin = -1.0f;
+	parameters.gcTailProbability = 0.0f;
+	parameters.bBlocked = false;
+	parameters.numThreads = 1;
+	parameters.scoringKernel = AUTO_KERNEL;
+
+	// parse parameters
+	int p = 1;
+	while(p < argc)
+	{
+		if(strcmp(argv[p], "-q") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.queryFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-m") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.modelFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-r") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.resultsFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-b") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.batchSize = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-t") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.topModels = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-v") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.verbose = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-g", "--interleave"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.groupSize = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-c", "--collapse"))
+		{
+			parameters.bCompactKmers = true;
+			p++;
+		}
+		else if(isOption(argv[p], "-f", "--fused"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.fusedTileSize = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-s", "--blocked"))
+		{
+			parameters.bBlocked = true;
+			p++;
+		}
+		else if(isOption(argv[p], "-p", "--threads"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.numThreads = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-n", "--null-model"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.nullModelFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-l", "--low-rank"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.lowRankFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-w", "--gc-tail"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.gcTailProbability = (float)atof(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-u", "--skipped-pairs"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.skippedPairsFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-o", "--sketch-min-length"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.minSketchLength = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-j", "--clusters"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.clusterFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-z", "--clusters-scored"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.expandedClusters = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-k", "--exact-index"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.exactIndexFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-a", "--prefilter"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.prefilterModelFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-d", "--eliminate"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.eliminationMargin = (float)atof(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-y", "--candidate-margin"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.candidateMargin = (float)atof(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-x", "--candidates"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.rescoreCandidates = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-i", "--instruction-set"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			if(!parseScoringKernel(argv[p+1], parameters.scoringKernel))
+			{
+				std::cout << "Unrecognized instruction set: " << argv[p+1] << std::endl << std::endl;
+				return false;
+			}
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--format") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.resultsFormat = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--mates") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.mateFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--interleaved") == 0)
+		{
+			parameters.bInterleaved = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--window") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.windowLength = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--step") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.windowStep = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--sketches") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.sketchFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--help") == 0 || strcmp(argv[p], "-h") == 0)
+		{
+			parameters.bShowHelp = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--version") == 0)
+		{
+			parameters.bShowVersion = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--contact") == 0)
+		{
+			parameters.bShowContactInfo = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "-e") == 0)
+		{
+			// temporary files are no longer used, option retained for compatibility
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			p += 2;
+		}
+		else
+		{
+			std::cout << "Unrecognized parameter: " << argv[p] << std::endl << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct TopModel
+{
+	TopModel(): modelNum(0), logLikelihood(-1e10) {} 
+	TopModel(uint _modelNum, float _logLikelihood): modelNum(_modelNum), logLikelihood(_logLikelihood) {}
+
+	uint modelNum;
+	float logLikelihood;
+};
+
+void updateTopModels(std::list<TopModel>& topModels, uint modelNum, float logLikelihood, int numTopModels)
+{
+	if(topModels.size() == 0)
+		topModels.push_front(TopModel(modelNum, logLikelihood));
+
+	std::list<TopModel>::iterator it;
+	bool bInserted = false;
+	for(it = topModels.begin(); it != topModels.end(); it++)
+	{
+		if(logLikelihood > it->logLikelihood)
+		{
+			topModels.insert(it, TopModel(modelNum, logLikelihood));
+			bInserted = true;
+			break;
+		}
+	}
+
+	if((int)topModels.size() < numTopModels && !bInserted)
+		topModels.push_back(TopModel(modelNum, logLikelihood));
+	else if((int)topModels.size() > numTopModels)
+			topModels.pop_back();
+}
+
+// maximum number of models whose log likelihoods are held in registers while n-mers are calculated
+const uint MAX_FUSED_TILE_SIZE = 8;
+
+// Adds the log probability of each k-mer under every model in a tile as the k-mer is formed
+template<uint N>
+struct FusedKmerScorer
+{
+	void operator()(uint kmer)
+	{
+		for(uint m = 0; m < N; ++m)
+			sums[m] += logProbs[m][kmer];
+	}
+
+	const float* logProbs[N];
+	float sums[N];
+};
+
+// Passes the canonical index of each k-mer to another visitor
+template<class KmerVisitor>
+struct CanonicalKmerVisitor
+{
+	CanonicalKmerVisitor(const KmerCalculator& _kmerCalculator, KmerVisitor& _visitor): kmerCalculator(_kmerCalculator), visitor(_visitor) {}
+
+	void operator()(uint kmer) { visitor(kmerCalculator.canonicalIndex(kmer)); }
+
+	const KmerCalculator& kmerCalculator;
+	KmerVisitor& visitor;
+};
+
+template<uint N>
+void classifyFusedTile(KmerCalculator& kmerCalculator, FragmentTable& queryFragments, const std::vector<KmerModel*>& modelTile, 
+												uint firstModel, std::vector< std::vector<float> >& tileLogLikelihoods)
+{
+	bool bCanonical = modelTile[firstModel]->canonical();
+
+	for(uint seqIndex = 0; seqIndex < queryFragments.size(); ++seqIndex)
+	{
+		FusedKmerScorer<N> scorer;
+		for(uint m = 0; m < N; ++m)
+		{
+			scorer.logProbs[m] = modelTile[firstModel + m]->logConditionalProb();
+			scorer.sums[m] = 0.0f;
+		}
+
+		ulong validKmers;
+		if(bCanonical)
+		{
+			CanonicalKmerVisitor< FusedKmerScorer<N> > canonicalScorer(kmerCalculator, scorer);
+			validKmers = kmerCalculator.visitForwardKmers(queryFragments.seqStore(), 
+													queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), canonicalScorer);
+		}
+		else
+		{
+			validKmers = kmerCalculator.visitForwardKmers(queryFragments.seqStore(), 
+													queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), scorer);
+		}
+		queryFragments.validKmers(seqIndex, validKmers);
+
+		for(uint m = 0; m < N; ++m)
+			tileLogLikelihoods[firstModel + m][seqIndex] = scorer.sums[m];
+	}
+}
+
+void classifyFused(KmerCalculator& kmerCalculator, FragmentTable& queryFragments, const std::vector<KmerModel*>& modelTile, 
+										std::vector< std::vector<float> >& tileLogLikelihoods)
+{
+	for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
+		tileLogLikelihoods[tileIndex].resize(queryFragments.size());
+
+	// models are applied in groups of fixed size so their sums can be kept in registers
+	uint m = 0;
+	while(m < modelTile.size())
+	{
+		uint remaining = modelTile.size() - m;
+		if(remaining >= 8)
+		{
+			classifyFusedTile<8>(kmerCalculator, queryFragments, modelTile, m, tileLogLikelihoods);
+			m += 8;
+		}
+		else if(remaining >= 4)
+		{
+			classifyFusedTile<4>(kmerCalculator, queryFragments, modelTile, m, tileLogLikelihoods);
+			m += 4;
+		}
+		else if(remaining >= 2)
+		{
+			classifyFusedTile<2>(kmerCalculator, queryFragments, modelTile, m, tileLogLikelihoods);
+			m += 2;
+		}
+		else
+		{
+			classifyFusedTile<1>(kmerCalculator, queryFragments, modelTile, m, tileLogLikelihoods);
+			m += 1;
+		}
+	}
+}
+
+void classifySparse(FragmentTable& queryFragments, const KmerModel& kmerModel, std::vector<float>& logLikelihoods)
+{
+	logLikelihoods.resize(queryFragments.size());
+	for(uint seqIndex = 0; seqIndex < queryFragments.size(); ++seqIndex)
+	{
+		ulong validKmers;
+		logLikelihoods[seqIndex] = kmerModel.classify(queryFragments.seqStore(), 
+													queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), validKmers);
+		queryFragments.validKmers(seqIndex, validKmers);
+	}
+}
+
+// Finds the model file of each entry of an index built by nb-train, which names each model file after its
+// sequence file. Returns the first model file without an entry, or -1 if all model files are matched.
+int matchModelFiles(const std::vector<std::string>& indexNames, const std::vector<std::string>& modelFiles, 
+										std::vector<uint>& modelIndices, std::vector<std::string>& modelNames)
+{
+	std::map<std::string, uint> indexEntries;
+	for(uint entry = 0; entry < indexNames.size(); ++entry)
+		indexEntries[indexNames[entry]] = entry;
+
+	modelIndices.assign(indexNames.size(), 0);
+	modelNames.clear();
+	for(uint modelIndex = 0; modelIndex < modelFiles.size(); ++modelIndex)
+	{
+		std::string modelName = modelFiles[modelIndex].substr(modelFiles[modelIndex].find_last_of("/\\") + 1, std::string::npos);
+		modelName = modelName.substr(0, modelName.find_last_of('.'));
+
+		std::map<std::string, uint>::iterator it = indexEntries.find(modelName);
+		if(it == indexEntries.end())
+			return modelIndex;
+
+		modelIndices[it->second] = modelIndex;
+		indexEntries.erase(it);
+		modelNames.push_back(modelName);
+	}
+
+	return -1;
+}
+
+// GC content of each fragment, or -1 if it has no unambiguous bases
+void calculateGCFractions(const FragmentTable& queryFragments, std::vector<float>& fractions)
+{
+	fractions.resize(queryFragments.size());
+	for(uint seqIndex = 0; seqIndex < queryFragments.size(); ++seqIndex)
+	{
+		ulong validBases;
+		ulong gcBases = queryFragments.seqStore().gcCount(queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), validBases);
+		fractions[seqIndex] = (validBases > 0) ? (float)gcBases / validBases : -1.0f;
+	}
+}
+
+// Applies a model to the fragments whose GC content is plausible under the GC distribution of the model. All
+// other fragments are given a log likelihood of -FLT_MAX, so they are not considered as top models, and are
+// written to the skipped pairs file if it is open. Returns the number of skipped fragments.
+ulong classifyGCPruned(const KmerModel& kmerModel, const FragmentTable& queryFragments, const std::vector<float>& gcFractions, 
+												const std::vector<KmerSpan>& profiles, uint groupSize, float tailProbability, 
+												std::ofstream& skippedPairsStream, std::vector<float>& logLikelihoods)
+{
+	logLikelihoods.assign(profiles.size(), -FLT_MAX);
+
+	std::vector<KmerSpan> keptProfiles;
+	std::vector<uint> keptFragments;
+	for(uint seqIndex = 0; seqIndex < profiles.size(); ++seqIndex)
+	{
+		// GC content of fragments shorter than the windows varies more than the distribution indicates
+		if(kmerModel.hasGCDistribution() && gcFractions[seqIndex] >= 0 && queryFragments.length(seqIndex) >= kmerModel.gcWindowLength()
+				&& kmerModel.gcTailProbability(gcFractions[seqIndex]) < tailProbability)
+		{
+			if(skippedPairsStream.is_open())
+			{
+				skippedPairsStream << queryFragments.seqId(seqIndex) << "\t" << kmerModel.name() << "\t" << gcFractions[seqIndex] 
+					<< "\t" << kmerModel.gcTailProbability(gcFractions[seqIndex]) << "\n";
+			}
+		}
+		else
+		{
+			keptProfiles.push_back(profiles[seqIndex]);
+			keptFragments.push_back(seqIndex);
+		}
+	}
+
+	std::vector<float> keptLogLikelihoods;
+	kmerModel.classify(keptProfiles, groupSize, keptLogLikelihoods);
+	for(uint i = 0; i < keptFragments.size(); ++i)
+		logLikelihoods[keptFragments[i]] = keptLogLikelihoods[i];
+
+	return profiles.size() - keptFragments.size();
+}
+
+// Applies every model to the fragments for which all models were skipped based on GC content, reading
+// the models again so each fragment is still assigned its most likely models
+bool classifyAllPruned(const std::string& modelFile, const std::vector<KmerSpan>& profiles, uint groupSize, int numTopModels, 
+												std::vector< std::list<TopModel> >& topModelsPerFragment, uint& numPrunedFragments)
+{
+	std::vector<uint> fragments;
+	for(uint seqIndex = 0; seqIndex < topModelsPerFragment.size(); ++seqIndex)
+	{
+		if(topModelsPerFragment[seqIndex].empty())
+			fragments.push_back(seqIndex);
+	}
+
+	numPrunedFragments = fragments.size();
+	if(fragments.empty())
+		return true;
+
+	std::vector<KmerSpan> prunedProfiles;
+	for(uint i = 0; i < fragments.size(); ++i)
+		prunedProfiles.push_back(profiles[fragments[i]]);
+
+	std::ifstream modelStream(modelFile.c_str(), std::ios::in);
+	std::vector<float> logLikelihoods;
+	for(uint modelNum = 0; ; ++modelNum)
+	{
+		std::string line;
+		std::getline(modelStream, line);
+		if(line.empty())
+			break;
+
+		KmerModel kmerModel(line);
+		if(!kmerModel.valid())
+			return false;
+
+		kmerModel.classify(prunedProfiles, groupSize, logLikelihoods);
+		for(uint i = 0; i < fragments.size(); ++i)
+			updateTopModels(topModelsPerFragment[fragments[i]], modelNum, logLikelihoods[i], numTopModels);
+	}
+
+	return true;
+}
+
+// Applies a model to each window of each fragment using prefix sums of the log probabilities of the k-mers of
+// the fragment, so each k-mer is looked up once no matter how many windows contain it
+void classifyWindows(const KmerModel& kmerModel, const std::vector<KmerSpan>& profiles, const FragmentWindows& windows, std::vector<float>& logLikelihoods)
+{
+	logLikelihoods.resize(windows.size());
+
+	const float* logProb = kmerModel.logConditionalProb();
+	std::vector<double> prefixSums;
+	for(uint seqIndex = 0; seqIndex < profiles.size(); ++seqIndex)
+	{
+		const KmerSpan& profile = profiles[seqIndex];
+		prefixSums.resize(profile.numKmers + 1);
+		prefixSums[0] = 0;
+		for(ulong i = 0; i < profile.numKmers; ++i)
+			prefixSums[i+1] = prefixSums[i] + logProb[profile.kmers[i]];
+
+		for(uint window = windows.firstWindow(seqIndex); window < windows.firstWindow(seqIndex+1); ++window)
+		{
+			ulong firstKmer = windows.firstKmer(window);
+			logLikelihoods[window] = (float)(prefixSums[firstKmer + windows.validKmers(window)] - prefixSums[firstKmer]);
+		}
+	}
+}
+
+// Id, length, and number of valid n-mers of a fragment, or of a window when windows are classified.
+// The length of a pair of mates is the total length of both mates.
+void resultsRowInfo(const FragmentTable& queryFragments, const FragmentWindows* windows, bool bPaired, uint row, 
+										std::string& id, ulong& length, ulong& validKmers)
+{
+	if(windows)
+	{
+		id = windows->id(queryFragments, row);
+		length = windows->length(row);
+		validKmers = windows->validKmers(row);
+	}
+	else
+	{
+		id = queryFragments.seqId(row);
+		length = queryFragments.length(row) - (bPaired ? 1 : 0);
+		validKmers = queryFragments.validKmers(row);
+	}
+}
+
+void writeResultsRow(std::ostream& resultsStream, const FragmentTable& queryFragments, const FragmentWindows* windows, bool bPaired, uint row)
+{
+	std::string id;
+	ulong length, validKmers;
+	resultsRowInfo(queryFragments, windows, bPaired, row, id, length, validKmers);
+
+	resultsStream << id << "\t" << length << "\t" << validKmers;
+}
+
+// number of k-mers visited before partial log likelihoods are first compared when eliminating models early, 
+// with later checkpoints doubling the number of k-mers visited
+static const ulong FIRST_ELIMINATION_CHECKPOINT = 64;
+
+// Partial log likelihoods at each elimination checkpoint of the models among the top T models of a fragment
+struct TopModelPartials
+{
+	std::vector<uint> modelNums;
+	std::vector< std::vector<float> > partials;
+};
+
+// Randomly permutes the k-mers of a profile, along with their counts, so that each prefix is a sample of the fragment
+void shuffleKmers(uint* kmers, uint* counts, ulong numKmers, std::mt19937& generator)
+{
+	for(ulong i = numKmers; i > 1; --i)
+	{
+		ulong j = generator() % i;
+		std::swap(kmers[i-1], kmers[j]);
+		if(counts)
+			std::swap(counts[i-1], counts[j]);
+	}
+}
+
+// Applies a model to the randomly ordered k-mers of each fragment, stopping at a checkpoint once the partial log 
+// likelihood trails that of the T-th best model over the same k-mers by more than margin * sqrt(k-mers visited).
+// This is a Hoeffding bound on the mean difference per k-mer, with the margin absorbing the range of differences 
+// and the confidence. Eliminated fragments are given a log likelihood of -FLT_MAX. Returns the number of k-mer 
+// lookups saved.
+ulong classifyProgressive(const KmerModel& kmerModel, uint modelNum, const std::vector<KmerSpan>& profiles, 
+													const std::vector< std::list<TopModel> >& topModelsPerFragment, int numTopModels, float margin,
+													std::vector<TopModelPartials>& topModelPartials, std::vector<float>& logLikelihoods)
+{
+	logLikelihoods.resize(profiles.size());
+
+	ulong savedLookups = 0;
+	std::vector<float> partials;
+	for(uint seqIndex = 0; seqIndex < profiles.size(); ++seqIndex)
+	{
+		const KmerSpan& profile = profiles[seqIndex];
+		const std::list<TopModel>& topModels = topModelsPerFragment[seqIndex];
+		TopModelPartials& fragmentPartials = topModelPartials[seqIndex];
+
+		// partial log likelihoods of the T-th best model, which a model must beat to be reported
+		const std::vector<float>* reference = NULL;
+		if((int)topModels.size() >= numTopModels)
+		{
+			for(uint i = 0; i < fragmentPartials.modelNums.size(); ++i)
+			{
+				if(fragmentPartials.modelNums[i] == topModels.back().modelNum)
+					reference = &fragmentPartials.partials[i];
+			}
+		}
+
+		partials.clear();
+		float sum = 0;
+		ulong visited = 0;
+		bool bEliminated = false;
+		for(ulong checkpoint = FIRST_ELIMINATION_CHECKPOINT; checkpoint < profile.numKmers; checkpoint *= 2)
+		{
+			KmerSpan segment(profile.kmers + visited, checkpoint - visited);
+			segment.counts = profile.counts ? profile.counts + visited : NULL;
+			sum += kmerModel.classify(segment);
+			visited = checkpoint;
+			partials.push_back(sum);
+
+			if(reference && sum < (*reference)[partials.size()-1] - margin * sqrt((float)visited))
+			{
+				bEliminated = true;
+				break;
+			}
+		}
+
+		if(bEliminated)
+		{
+			logLikelihoods[seqIndex] = -FLT_MAX;
+			savedLookups += profile.numKmers - visited;
+			continue;
+		}
+
+		KmerSpan segment(profile.kmers + visited, profile.numKmers - visited);
+		segment.counts = profile.counts ? profile.counts + visited : NULL;
+		sum += kmerModel.classify(segment);
+		logLikelihoods[seqIndex] = sum;
+
+		// record partial log likelihoods of models that will enter the top T models, discarding those that have left
+		if(!partials.empty() && ((int)topModels.size() < numTopModels || sum > topModels.back().logLikelihood))
+		{
+			if(fragmentPartials.modelNums.size() >= 2 * (uint)numTopModels)
+			{
+				TopModelPartials current;
+				for(std::list<TopModel>::const_iterator it = topModels.begin(); it != topModels.end(); ++it)
+				{
+					for(uint i = 0; i < fragmentPartials.modelNums.size(); ++i)
+					{
+						if(fragmentPartials.modelNums[i] == it->modelNum)
+						{
+							current.modelNums.push_back(it->modelNum);
+							current.partials.push_back(fragmentPartials.partials[i]);
+						}
+					}
+				}
+				fragmentPartials = current;
+			}
+
+			fragmentPartials.modelNums.push_back(modelNum);
+			fragmentPartials.partials.push_back(partials);
+		}
+	}
+
+	return savedLookups;
+}
+
+// Calculates the n-mers of each query fragment, which are collapsed with -c and placed in random order with -d,
+// along with the n-mers of the prefilter models if a prefilter calculator is given
+void calculateProfiles(const Parameters& parameters, FragmentTable& queryFragments, KmerCalculator& kmerCalculator, bool bCanonical, bool bProgressive,
+												std::mt19937& kmerOrderGenerator, KmerCalculator* prefilterCalculator, KmerProfileArena& queryProfiles,
+												KmerProfileArena& prefilterProfiles, std::ostream& progressStream)
+{
+	if(parameters.verbose >= 1)
+		progressStream << "  Calculating n-mers in query fragment: " << std::endl;	
+
+	for(uint seqIndex = 0; seqIndex < queryFragments.size(); ++seqIndex)
+	{
+		if(parameters.verbose >= 3)
+			progressStream << queryFragments.seqId(seqIndex) << std::endl;
+		else if (seqIndex % 5000 == 0 && parameters.verbose >= 1)
+			progressStream << "." << std::flush;
+
+		uint* profile = queryProfiles.beginProfile(kmerCalculator.maxKmers(queryFragments.length(seqIndex)));
+		ulong validKmers = kmerCalculator.extractForwardKmers(queryFragments.seqStore(), 
+					queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), profile);
+		queryFragments.validKmers(seqIndex, validKmers);
+
+		if(bCanonical)
+			kmerCalculator.canonicalIndices(profile, validKmers);
+
+		ulong numKmers = validKmers;
+		uint* counts = NULL;
+		if(parameters.bCompactKmers)
+		{
+			counts = queryProfiles.beginCounts();
+			numKmers = kmerCalculator.compactKmers(profile, validKmers, counts);
+		}
+
+		if(bProgressive)
+			shuffleKmers(profile, counts, numKmers, kmerOrderGenerator);
+
+		queryProfiles.endProfile(numKmers);
+
+		if(prefilterCalculator != NULL)
+		{
+			uint* prefilterProfile = prefilterProfiles.beginProfile(prefilterCalculator->maxKmers(queryFragments.length(seqIndex)));
+			ulong prefilterKmers = prefilterCalculator->extractForwardKmers(queryFragments.seqStore(), 
+						queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), prefilterProfile);
+			prefilterProfiles.endProfile(prefilterKmers);
+		}
+	}
+	if(parameters.verbose >= 1)
+		progressStream << std::endl;
+}
+
+// Reads the null model and the delta models, which are held in memory and applied together
+bool readDeltaModels(const Parameters& parameters, uint kmerLength, KmerModel*& nullModel, DeltaIndex& deltaIndex,
+											std::vector<std::string>& modelNames, std::vector<std::string>& modelTaxonomies, std::ostream& progressStream)
+{
+	if(parameters.nullModelFile.empty())
+	{
+		progressStream << "Delta models require the null model they were trained against (-n)." << std::endl;
+		return false;
+	}
+
+	std::ifstream nullModelStream(parameters.nullModelFile.c_str(), std::ios::in | std::ios::binary);
+	if(nullModelStream.fail())
+	{
+		progressStream << "Failed to open null model: " << parameters.nullModelFile << std::endl;
+		return false;
+	}
+	nullModelStream.close();
+
+	nullModel = new KmerModel(parameters.nullModelFile);
+	if(!nullModel->valid())
+		return false;
+
+	if(nullModel->kmerLength() != kmerLength || nullModel->canonical() || nullModel->sparse() || nullModel->delta())
+	{
+		progressStream << "Null model must be a dense model with an n-mer length of " << kmerLength << "." << std::endl;
+		return false;
+	}
+
+	if(parameters.verbose >= 1)
+		progressStream << "Reading delta models:" << std::endl;
+
+	std::ifstream modelStream(parameters.modelFile.c_str(), std::ios::in);
+	while(true)
+	{
+		std::string line;
+		std::getline(modelStream, line);
+		if(line.empty())
+			break;
+
+		if(modelNames.size() % 200 == 0 && parameters.verbose >= 1)
+			progressStream << " " << modelNames.size() << std::flush;
+
+		KmerModel kmerModel(line);
+		if(!kmerModel.valid())
+			return false;
+
+		if(kmerModel.kmerLength() != kmerLength || !kmerModel.delta())
+		{
+			progressStream << "Model " << line << " must have the same n-mer length and format as the first model." << std::endl;
+			return false;
+		}
+		if(parameters.verbose >= 2)
+		{
+			kmerModel.printModelInfo(progressStream);
+			progressStream << std::endl;
+		}
+
+		deltaIndex.add(kmerModel);
+		modelNames.push_back(kmerModel.name());
+		modelTaxonomies.push_back(kmerModel.taxonomy().taxonomyStr());
+	}
+	deltaIndex.build(kmerLength);
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << std::endl;
+		progressStream << "  Number of differences from null model: " << deltaIndex.numPostings() << std::endl;
+		progressStream << "  Delta index: " << deltaIndex.memoryUsage() << " bytes" << std::endl << std::endl;
+	}
+
+	return true;
+}
+
+// Applies delta models to each fragment, where the log likelihood of each model is the null model log likelihood
+// plus the model's differences
+void classifyDelta(const KmerModel& nullModel, const DeltaIndex& deltaIndex, uint numModels, const std::vector<KmerSpan>& profiles, uint groupSize,
+										bool bRecordAllModels, int numTopModels, std::vector< std::vector<float> >& modelLogLikelihoods,
+										std::vector< std::list<TopModel> >& topModelsPerFragment)
+{
+	std::vector<float> nullLogLikelihoods;
+	nullModel.classify(profiles, groupSize, nullLogLikelihoods);
+
+	if(bRecordAllModels)
+		modelLogLikelihoods.assign(numModels, std::vector<float>(profiles.size()));
+
+	std::vector<float> logLikelihoods(numModels);
+	for(uint seqIndex = 0; seqIndex < profiles.size(); ++seqIndex)
+	{
+		std::fill(logLikelihoods.begin(), logLikelihoods.end(), nullLogLikelihoods[seqIndex]);
+		deltaIndex.score(profiles[seqIndex], logLikelihoods.empty() ? NULL : &logLikelihoods[0]);
+
+		for(uint modelIndex = 0; modelIndex < logLikelihoods.size(); ++modelIndex)
+		{
+			if(bRecordAllModels)
+				modelLogLikelihoods[modelIndex][seqIndex] = logLikelihoods[modelIndex];
+			else
+				updateTopModels(topModelsPerFragment[seqIndex], modelIndex, logLikelihoods[modelIndex], numTopModels);
+		}
+	}
+}
+
+// Approximate models, indices, or clusters of the models that select the candidate models of each fragment
+// which are re-scored exactly (see -l, -a, -k, --sketches, and -j)
+struct CandidateModels
+{
+	CandidateModels(const Parameters& parameters)
+		: bLowRank(!parameters.lowRankFile.empty()), bCascade(!parameters.prefilterModelFile.empty()), bExact(!parameters.exactIndexFile.empty()),
+			bSketch(!parameters.sketchFile.empty()), bClusters(!parameters.clusterFile.empty()), prefilterKmerLength(0) {}
+
+	~CandidateModels()
+	{
+		for(uint clusterIndex = 0; clusterIndex < centroidModels.size(); ++clusterIndex)
+			delete centroidModels[clusterIndex];
+	}
+
+	bool any() const { return bLowRank || bCascade || bExact || bSketch || bClusters; }
+
+	bool bLowRank, bCascade, bExact, bSketch, bClusters;
+
+	LowRankModel lowRankModel;
+	std::vector<ModelBlock> prefilterBlocks;
+	uint prefilterKmerLength;
+	ExactKmerIndex exactIndex;
+	SketchIndex sketchIndex;
+	std::vector<KmerModel*> centroidModels;
+	std::vector< std::vector<uint> > clusterMembers;
+
+	// model files in the order of the model file, with the name and taxonomy of each model
+	std::vector<std::string> modelFiles;
+	std::vector<std::string> modelNames;
+	std::vector<std::string> modelTaxonomies;
+};
+
+bool readLowRankModel(const Parameters& parameters, uint kmerLength, bool bCanonical, CandidateModels& candidates, std::ostream& progressStream)
+{
+	if(!candidates.lowRankModel.read(parameters.lowRankFile))
+		return false;
+
+	if(candidates.lowRankModel.kmerLength() != kmerLength || candidates.lowRankModel.canonical() != bCanonical)
+	{
+		progressStream << "Low-rank model must have the same n-mer length and format as the models." << std::endl;
+		return false;
+	}
+
+	if(candidates.modelFiles.size() != candidates.lowRankModel.numModels())
+	{
+		progressStream << "Low-rank model was built from " << candidates.lowRankModel.numModels() << " models, but model file lists " << candidates.modelFiles.size() << "." << std::endl;
+		return false;
+	}
+
+	// models are identified by position so the model file must list them in the order they were compressed
+	for(uint modelIndex = 0; modelIndex < candidates.lowRankModel.numModels(); ++modelIndex)
+	{
+		std::string modelName;
+		if(!KmerModel::readModelName(candidates.modelFiles[modelIndex], modelName))
+		{
+			progressStream << "Failed to read model: " << candidates.modelFiles[modelIndex] << std::endl;
+			return false;
+		}
+		else if(modelName != candidates.lowRankModel.name(modelIndex))
+		{
+			progressStream << "Model " << candidates.modelFiles[modelIndex] << " does not match the low-rank model." << std::endl;
+			return false;
+		}
+
+		candidates.modelNames.push_back(candidates.lowRankModel.name(modelIndex));
+	}
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << "Low-rank approximation of models:" << std::endl;
+		progressStream << "  Rank: " << candidates.lowRankModel.rank() << std::endl;
+		progressStream << "  Low-rank model: " << candidates.lowRankModel.memoryUsage() << " bytes" << std::endl << std::endl;
+	}
+
+	return true;
+}
+
+// prefilter models are small so all are held in memory as interleaved blocks
+bool readPrefilterModels(const Parameters& parameters, CandidateModels& candidates, std::ostream& progressStream)
+{
+	std::ifstream prefilterStream(parameters.prefilterModelFile.c_str(), std::ios::in);
+	if(prefilterStream.fail())
+	{
+		progressStream << "Failed to open prefilter model file: " << parameters.prefilterModelFile << std::endl;
+		return false;
+	}
+
+	std::vector<KmerModel*> prefilterModels;
+	while(true)
+	{
+		std::string line;
+		std::getline(prefilterStream, line);
+		if(line.empty())
+			break;
+
+		KmerModel* prefilterModel = new KmerModel(line);
+		if(!prefilterModel->valid())
+			return false;
+
+		if(prefilterModels.empty())
+			candidates.prefilterKmerLength = prefilterModel->kmerLength();
+
+		if(prefilterModel->kmerLength() != candidates.prefilterKmerLength || prefilterModel->canonical() || prefilterModel->sparse() || prefilterModel->delta())
+		{
+			progressStream << "Prefilter model " << line << " must be a dense model with the same n-mer length as the first prefilter model." << std::endl;
+			return false;
+		}
+
+		candidates.modelNames.push_back(prefilterModel->name());
+		prefilterModels.push_back(prefilterModel);
+	}
+
+	if(prefilterModels.size() != candidates.modelFiles.size())
+	{
+		progressStream << "Prefilter model file lists " << prefilterModels.size() << " models, but model file lists " << candidates.modelFiles.size() << "." << std::endl;
+		return false;
+	}
+
+	for(uint firstModel = 0; firstModel < prefilterModels.size(); firstModel += MODEL_BLOCK_WIDTH)
+	{
+		candidates.prefilterBlocks.push_back(ModelBlock());
+		candidates.prefilterBlocks.back().set(prefilterModels, firstModel, std::min(MODEL_BLOCK_WIDTH, (uint)prefilterModels.size() - firstModel));
+	}
+
+	for(uint modelIndex = 0; modelIndex < prefilterModels.size(); ++modelIndex)
+		delete prefilterModels[modelIndex];
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << "Prefilter models:" << std::endl;
+		progressStream << "  n-mer length: " << candidates.prefilterKmerLength << std::endl;
+		progressStream << "  Number of prefilter models: " << candidates.modelNames.size() << std::endl << std::endl;
+	}
+
+	return true;
+}
+
+bool readExactIndex(const Parameters& parameters, CandidateModels& candidates, std::ostream& progressStream)
+{
+	if(!candidates.exactIndex.read(parameters.exactIndexFile))
+		return false;
+
+	if(candidates.exactIndex.numStrains() != candidates.modelFiles.size())
+	{
+		progressStream << "Exact k-mer index was built from " << candidates.exactIndex.numStrains() << " sequence files, but model file lists " << candidates.modelFiles.size() << " models." << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> strainNames;
+	for(uint strainIndex = 0; strainIndex < candidates.exactIndex.numStrains(); ++strainIndex)
+		strainNames.push_back(candidates.exactIndex.name(strainIndex));
+
+	std::vector<uint> modelIndices;
+	int unmatchedModel = matchModelFiles(strainNames, candidates.modelFiles, modelIndices, candidates.modelNames);
+	if(unmatchedModel >= 0)
+	{
+		progressStream << "Model " << candidates.modelFiles[unmatchedModel] << " is not in the exact k-mer index." << std::endl;
+		return false;
+	}
+	candidates.exactIndex.renumberStrains(modelIndices);
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << "Exact k-mer index:" << std::endl;
+		progressStream << "  k-mer length: " << candidates.exactIndex.kmerLength() << std::endl;
+		progressStream << "  Number of k-mers: " << candidates.exactIndex.numKmers() << std::endl;
+		progressStream << "  Number of distinct strain sets: " << candidates.exactIndex.numStrainSets() << std::endl;
+		progressStream << "  Exact k-mer index: " << candidates.exactIndex.memoryUsage() << " bytes" << std::endl << std::endl;
+	}
+
+	return true;
+}
+
+bool readSketches(const Parameters& parameters, CandidateModels& candidates, std::ostream& progressStream)
+{
+	if(!candidates.sketchIndex.read(parameters.sketchFile))
+		return false;
+
+	if(candidates.sketchIndex.numModels() != candidates.modelFiles.size())
+	{
+		progressStream << "Sketches were built from " << candidates.sketchIndex.numModels() << " sequence files, but model file lists " << candidates.modelFiles.size() << " models." << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> sketchNames;
+	for(uint modelIndex = 0; modelIndex < candidates.sketchIndex.numModels(); ++modelIndex)
+		sketchNames.push_back(candidates.sketchIndex.name(modelIndex));
+
+	std::vector<uint> modelIndices;
+	int unmatchedModel = matchModelFiles(sketchNames, candidates.modelFiles, modelIndices, candidates.modelNames);
+	if(unmatchedModel >= 0)
+	{
+		progressStream << "Model " << candidates.modelFiles[unmatchedModel] << " has no sketch." << std::endl;
+		return false;
+	}
+	candidates.sketchIndex.renumberModels(modelIndices);
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << "Model sketches:" << std::endl;
+		progressStream << "  k-mer length: " << candidates.sketchIndex.kmerLength() << std::endl;
+		progressStream << "  Scale: " << candidates.sketchIndex.scale() << std::endl;
+		progressStream << "  Number of distinct hashes: " << candidates.sketchIndex.numHashes() << std::endl;
+		progressStream << "  Sketch index: " << candidates.sketchIndex.memoryUsage() << " bytes" << std::endl << std::endl;
+	}
+
+	return true;
+}
+
+// centroid models are held in memory, with each line of the cluster file giving a centroid model and a member model
+bool readClusters(const Parameters& parameters, uint kmerLength, bool bCanonical, CandidateModels& candidates, std::ostream& progressStream)
+{
+	std::ifstream clusterStream(parameters.clusterFile.c_str(), std::ios::in);
+	if(clusterStream.fail())
+	{
+		progressStream << "Failed to open cluster file: " << parameters.clusterFile << std::endl;
+		return false;
+	}
+
+	// centroid models written by nb-cluster are relative to the directory of the cluster file
+	std::string clusterDir = parameters.clusterFile.substr(0, parameters.clusterFile.find_last_of("/\\") + 1);
+
+	std::map<std::string, uint> centroidIndices;
+	std::vector<std::string> memberNames;
+	std::vector<uint> memberClusters;
+	while(true)
+	{
+		std::string line;
+		std::getline(clusterStream, line);
+		if(line.empty())
+			break;
+
+		std::string::size_type tab = line.find('\t');
+		if(tab == std::string::npos)
+		{
+			progressStream << "Invalid line in cluster file: " << line << std::endl;
+			return false;
+		}
+
+		std::string centroidFile = line.substr(0, tab);
+		if(centroidFile[0] != '/' && centroidFile[0] != '\\' && centroidFile.find(':') == std::string::npos)
+			centroidFile = clusterDir + centroidFile;
+
+		std::map<std::string, uint>::iterator it = centroidIndices.find(centroidFile);
+		if(it == centroidIndices.end())
+		{
+			KmerModel* centroidModel = new KmerModel(centroidFile);
+			if(!centroidModel->valid())
+				return false;
+
+			if(centroidModel->kmerLength() != kmerLength || centroidModel->canonical() != bCanonical || centroidModel->sparse() || centroidModel->delta())
+			{
+				progressStream << "Centroid model " << centroidFile << " must have the same n-mer length and format as the models." << std::endl;
+				return false;
+			}
+
+			it = centroidIndices.insert(std::make_pair(centroidFile, (uint)candidates.centroidModels.size())).first;
+			candidates.centroidModels.push_back(centroidModel);
+		}
+
+		std::string memberName = line.substr(line.find_last_of("/\\") + 1, std::string::npos);
+		memberNames.push_back(memberName.substr(0, memberName.find_last_of('.')));
+		memberClusters.push_back(it->second);
+	}
+
+	if(memberNames.size() != candidates.modelFiles.size())
+	{
+		progressStream << "Cluster file lists " << memberNames.size() << " models, but model file lists " << candidates.modelFiles.size() << " models." << std::endl;
+		return false;
+	}
+
+	std::vector<uint> modelIndices;
+	int unmatchedModel = matchModelFiles(memberNames, candidates.modelFiles, modelIndices, candidates.modelNames);
+	if(unmatchedModel >= 0)
+	{
+		progressStream << "Model " << candidates.modelFiles[unmatchedModel] << " is not in the cluster file." << std::endl;
+		return false;
+	}
+
+	candidates.clusterMembers.resize(candidates.centroidModels.size());
+	for(uint entry = 0; entry < memberNames.size(); ++entry)
+		candidates.clusterMembers[memberClusters[entry]].push_back(modelIndices[entry]);
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << "Clusters of models:" << std::endl;
+		progressStream << "  Number of clusters: " << candidates.centroidModels.size() << std::endl;
+		progressStream << "  Clusters scored per fragment: " << std::min((uint)parameters.expandedClusters, (uint)candidates.centroidModels.size()) << std::endl << std::endl;
+	}
+
+	return true;
+}
+
+// Reads the list of models and the approximate models, index, or clusters that select candidates among them
+bool readCandidateModels(const Parameters& parameters, uint kmerLength, bool bCanonical, bool bSparse, bool bDelta,
+													bool bRecordAllModels, bool bBinaryResults, CandidateModels& candidates, std::ostream& progressStream)
+{
+	if(bSparse || bDelta)
+	{
+		progressStream << "Candidate re-scoring is only supported for dense and canonical models." << std::endl;
+		return false;
+	}
+	else if((int)candidates.bLowRank + (int)candidates.bCascade + (int)candidates.bExact + (int)candidates.bSketch + (int)candidates.bClusters > 1)
+	{
+		progressStream << "Only one of a low-rank model (-l), prefilter models (-a), an exact k-mer index (-k), sketches (--sketches), or clusters (-j) can be used." << std::endl;
+		return false;
+	}
+	else if(candidates.bCascade && bRecordAllModels)
+	{
+		progressStream << "Prefilter models (-a) require the top T models to be reported (-t)." << std::endl;
+		return false;
+	}
+	else if(candidates.bExact && bRecordAllModels)
+	{
+		progressStream << "An exact k-mer index (-k) requires the top T models to be reported (-t)." << std::endl;
+		return false;
+	}
+	else if(candidates.bSketch && bRecordAllModels)
+	{
+		progressStream << "Sketches (--sketches) require the top T models to be reported (-t)." << std::endl;
+		return false;
+	}
+	else if(candidates.bClusters && bRecordAllModels)
+	{
+		progressStream << "Clusters (-j) require the top T models to be reported (-t)." << std::endl;
+		return false;
+	}
+	else if(candidates.bClusters && parameters.expandedClusters < 1)
+	{
+		progressStream << "At least 1 cluster must be scored for each fragment (-z)." << std::endl;
+		return false;
+	}
+
+	std::ifstream modelStream(parameters.modelFile.c_str(), std::ios::in);
+	while(true)
+	{
+		std::string line;
+		std::getline(modelStream, line);
+		if(line.empty())
+			break;
+		candidates.modelFiles.push_back(line);
+	}
+
+	bool bRead;
+	if(candidates.bLowRank)
+		bRead = readLowRankModel(parameters, kmerLength, bCanonical, candidates, progressStream);
+	else if(candidates.bCascade)
+		bRead = readPrefilterModels(parameters, candidates, progressStream);
+	else if(candidates.bExact)
+		bRead = readExactIndex(parameters, candidates, progressStream);
+	else if(candidates.bSketch)
+		bRead = readSketches(parameters, candidates, progressStream);
+	else
+		bRead = readClusters(parameters, kmerLength, bCanonical, candidates, progressStream);
+
+	if(!bRead)
+		return false;
+
+	// binary results record the taxonomy of each candidate model, which is read without reading its tables
+	if(bBinaryResults)
+	{
+		for(uint modelIndex = 0; modelIndex < candidates.modelFiles.size(); ++modelIndex)
+		{
+			TaxonomyModel taxonomy;
+			if(!KmerModel::readTaxonomy(candidates.modelFiles[modelIndex], taxonomy))
+			{
+				progressStream << "Failed to read model: " << candidates.modelFiles[modelIndex] << std::endl;
+				return false;
+			}
+			candidates.modelTaxonomies.push_back(taxonomy.taxonomyStr());
+		}
+	}
+
+	return true;
+}
+
+// Selects the candidate models of each fragment and re-scores them exactly, where models are only read if
+// they are a candidate for some fragment
+bool classifyCandidates(const Parameters& parameters, const CandidateModels& candidates, const FragmentTable& queryFragments,
+												const std::vector<KmerSpan>& queryProfileSpans, const KmerProfileArena& prefilterProfiles, uint kmerLength, bool bCanonical,
+												bool bRecordAllModels, std::vector< std::vector<float> >& modelLogLikelihoods,
+												std::vector< std::list<TopModel> >& topModelsPerFragment, std::ostream& progressStream)
+{
+	const std::vector<std::string>& modelNames = candidates.modelNames;
+	uint numModels = modelNames.size();
+	if(bRecordAllModels)
+		modelLogLikelihoods.assign(numModels, std::vector<float>(queryFragments.size()));
+
+	// at least the top T models are re-scored unless only approximate log likelihoods are requested
+	uint numCandidates = 0;
+	if(parameters.rescoreCandidates > 0 || candidates.bCascade || candidates.bExact || candidates.bSketch)
+		numCandidates = std::min((uint)std::max(std::max(parameters.rescoreCandidates, parameters.topModels), 1), numModels);
+
+	// approximate log likelihoods from the projection of each fragment onto the basis tables 
+	// or from the prefilter models
+	std::vector<float> projection(candidates.lowRankModel.rank() + 1);
+	std::vector<float> logLikelihoods(std::max((uint)candidates.prefilterBlocks.size() * MODEL_BLOCK_WIDTH, numModels));
+	std::vector<uint> modelOrder(numModels);
+	std::vector< std::vector<uint> > candidateFragments(numModels);
+	std::vector<uint> hitCounts((candidates.bExact || candidates.bSketch) ? numModels : 0);
+	std::vector<uint64> querySketch;
+	uint numFallbackFragments = 0;
+
+	// centroid models are applied to all fragments so the members of the best clusters can be selected
+	std::vector< std::vector<float> > centroidLogLikelihoods(candidates.centroidModels.size());
+	for(uint clusterIndex = 0; clusterIndex < candidates.centroidModels.size(); ++clusterIndex)
+		candidates.centroidModels[clusterIndex]->classify(queryProfileSpans, parameters.groupSize, centroidLogLikelihoods[clusterIndex]);
+
+	uint numExpandedClusters = std::min((uint)parameters.expandedClusters, (uint)candidates.centroidModels.size());
+	std::vector<uint> clusterOrder(candidates.centroidModels.size());
+	for(uint seqIndex = 0; seqIndex < queryFragments.size(); ++seqIndex)
+	{
+		if(candidates.bClusters)
+		{
+			// all members of the clusters whose centroid gives the highest log likelihoods are candidates
+			for(uint clusterIndex = 0; clusterIndex < clusterOrder.size(); ++clusterIndex)
+				clusterOrder[clusterIndex] = clusterIndex;
+			std::nth_element(clusterOrder.begin(), clusterOrder.begin() + (numExpandedClusters - 1), clusterOrder.end(), 
+				[&centroidLogLikelihoods, seqIndex](uint a, uint b) { return centroidLogLikelihoods[a][seqIndex] > centroidLogLikelihoods[b][seqIndex]; });
+
+			for(uint c = 0; c < numExpandedClusters; ++c)
+			{
+				const std::vector<uint>& members = candidates.clusterMembers[clusterOrder[c]];
+				for(uint m = 0; m < members.size(); ++m)
+					candidateFragments[members[m]].push_back(seqIndex);
+			}
+
+			continue;
+		}
+
+		if(candidates.bExact || candidates.bSketch)
+		{
+			// models sharing the most exact k-mers or sketch hashes with the fragment are candidates, or all models if none are shared
+			std::fill(hitCounts.begin(), hitCounts.end(), 0);
+			if(candidates.bExact)
+				candidates.exactIndex.countHits(queryFragments.seqStore(), queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), &hitCounts[0]);
+			else if(queryFragments.length(seqIndex) >= (ulong)parameters.minSketchLength)
+			{
+				candidates.sketchIndex.sketch(queryFragments.seqStore(), queryFragments.seqOffset(seqIndex), queryFragments.length(seqIndex), querySketch);
+				candidates.sketchIndex.countShared(querySketch, &hitCounts[0]);
+			}
+
+			uint numSelected = 0;
+			for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+			{
+				if(hitCounts[modelIndex] > 0)
+					modelOrder[numSelected++] = modelIndex;
+			}
+
+			if(numSelected == 0)
+			{
+				for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+					modelOrder[modelIndex] = modelIndex;
+				numSelected = numModels;
+				numFallbackFragments++;
+			}
+			else if(numSelected > numCandidates)
+			{
+				std::nth_element(modelOrder.begin(), modelOrder.begin() + (numCandidates - 1), modelOrder.begin() + numSelected, 
+					[&hitCounts](uint a, uint b) { return hitCounts[a] > hitCounts[b]; });
+				numSelected = numCandidates;
+			}
+
+			for(uint c = 0; c < numSelected; ++c)
+				candidateFragments[modelOrder[c]].push_back(seqIndex);
+
+			continue;
+		}
+
+		if(candidates.bLowRank)
+		{
+			candidates.lowRankModel.project(queryProfileSpans[seqIndex], &projection[0]);
+			candidates.lowRankModel.logLikelihoods(&projection[0], &logLikelihoods[0]);
+		}
+		else
+		{
+			for(uint blockIndex = 0; blockIndex < candidates.prefilterBlocks.size(); ++blockIndex)
+				candidates.prefilterBlocks[blockIndex].classify(prefilterProfiles.profile(seqIndex), &logLikelihoods[blockIndex * MODEL_BLOCK_WIDTH]);
+		}
+
+		if(bRecordAllModels)
+		{
+			for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+				modelLogLikelihoods[modelIndex][seqIndex] = logLikelihoods[modelIndex];
+		}
 
-	// parse parameters
-	int p = 1;
-	while(p < argc)
-	{
-		if(strcmp(argv[p], "-q") == 0)
+		if(numCandidates > 0)
 		{
-			parameters.queryFile = argv[p+1];
-			p += 2;
+			for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+				modelOrder[modelIndex] = modelIndex;
+			std::nth_element(modelOrder.begin(), modelOrder.begin() + (numCandidates - 1), modelOrder.end(), 
+				[&logLikelihoods](uint a, uint b) { return logLikelihoods[a] > logLikelihoods[b]; });
+
+			uint numSelected = numCandidates;
+			if(parameters.candidateMargin >= 0)
+			{
+				float bestLogLikelihood = logLikelihoods[modelOrder[0]];
+				for(uint c = 1; c < numCandidates; ++c)
+					bestLogLikelihood = std::max(bestLogLikelihood, logLikelihoods[modelOrder[c]]);
+
+				for(uint c = numCandidates; c < numModels; ++c)
+				{
+					if(logLikelihoods[modelOrder[c]] >= bestLogLikelihood - parameters.candidateMargin)
+						std::swap(modelOrder[c], modelOrder[numSelected++]);
+				}
+			}
+
+			for(uint c = 0; c < numSelected; ++c)
+				candidateFragments[modelOrder[c]].push_back(seqIndex);
 		}
-		else if(strcmp(argv[p], "-m") == 0)
+		else if(!bRecordAllModels)
 		{
-			parameters.modelFile = argv[p+1];
-			p += 2;
+			for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+				updateTopModels(topModelsPerFragment[seqIndex], modelIndex, logLikelihoods[modelIndex], parameters.topModels);
 		}
-		else if(strcmp(argv[p], "-r") == 0)
+	}
+
+	// exact re-scoring, where models are only read if they are a candidate for some fragment
+	uint numModelsRead = 0;
+	ulong numRescored = 0;
+	std::vector<KmerSpan> candidateProfiles;
+	std::vector<float> exactLogLikelihoods;
+	for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+	{
+		const std::vector<uint>& fragments = candidateFragments[modelIndex];
+		if(fragments.empty())
+			continue;
+
+		KmerModel kmerModel(candidates.modelFiles[modelIndex]);
+		if(!kmerModel.valid())
+			return false;
+
+		if(kmerModel.name() != modelNames[modelIndex] || kmerModel.kmerLength() != kmerLength || kmerModel.canonical() != bCanonical)
 		{
-			parameters.resultsFile = argv[p+1];
-			p += 2;
+			progressStream << "Model " << candidates.modelFiles[modelIndex] << " does not match the " 
+				<< (candidates.bLowRank ? "low-rank model." : (candidates.bCascade ? "prefilter model." : (candidates.bExact ? "exact k-mer index." : (candidates.bSketch ? "sketches." : "cluster file.")))) << std::endl;
+			return false;
 		}
-		else if(strcmp(argv[p], "-b") == 0)
+		numModelsRead++;
+		numRescored += fragments.size();
+
+		candidateProfiles.clear();
+		for(uint i = 0; i < fragments.size(); ++i)
+			candidateProfiles.push_back(queryProfileSpans[fragments[i]]);
+		kmerModel.classify(candidateProfiles, parameters.groupSize, exactLogLikelihoods);
+
+		for(uint i = 0; i < fragments.size(); ++i)
 		{
-			parameters.batchSize = atoi(argv[p+1]);
-			p += 2;
+			if(bRecordAllModels)
+				modelLogLikelihoods[modelIndex][fragments[i]] = exactLogLikelihoods[i];
+			else
+				updateTopModels(topModelsPerFragment[fragments[i]], modelIndex, exactLogLikelihoods[i], parameters.topModels);
 		}
-		else if(strcmp(argv[p], "-t") == 0)
+	}
+
+	if(parameters.verbose >= 1)
+	{
+		progressStream << "  Re-scored " << (float)numRescored / std::max(queryFragments.size(), 1U) << " candidates per fragment using " 
+										<< numModelsRead << " of " << numModels << " models.";
+		if(candidates.bExact)
+			progressStream << " All models scored for " << numFallbackFragments << " fragments without exact k-mer hits.";
+		else if(candidates.bSketch)
+			progressStream << " All models scored for " << numFallbackFragments << " fragments that are short or share no sketch hashes.";
+	}
+
+
+	return true;
+}
+
+// Checks the options of modes that apply dense or canonical models one at a time to the stored n-mers of each
+// fragment, which are skipping models based on GC content (-w), eliminating models early (-d), and classifying
+// windows (--window), and opens the file of skipped fragment and model pairs
+bool setupSingleModelModes(Parameters& parameters, bool bRecordAllModels, bool bSingleModels, bool bPaired,
+														std::ofstream& skippedPairsStream, std::ostream& progressStream)
+{
+	bool bGCPrune = (parameters.gcTailProbability > 0);
+	bool bProgressive = (parameters.eliminationMargin >= 0);
+	bool bWindows = (parameters.windowLength > 0);
+
+	if(bGCPrune)
+	{
+		if(bRecordAllModels)
 		{
-			parameters.topModels = atoi(argv[p+1]);
-			p += 2;
+			progressStream << "Skipping models based on GC content (-w) requires the top T models to be reported (-t)." << std::endl;
+			return false;
 		}
-		else if(strcmp(argv[p], "-v") == 0)
+		else if(!bSingleModels)
 		{
-			parameters.verbose = atoi(argv[p+1]);
-			p += 2;
+			progressStream << "Skipping models based on GC content (-w) is only supported when dense or canonical models are applied one at a time." << std::endl;
+			return false;
 		}
-		else if(strcmp(argv[p], "--help") == 0)
+
+		if(!parameters.skippedPairsFile.empty())
 		{
-			parameters.bShowHelp = true;
-			p += 1;
+			skippedPairsStream.open(parameters.skippedPairsFile.c_str(), std::ios::out | std::ios::binary);
+			if(skippedPairsStream.fail())
+			{
+				progressStream << "Failed to open skipped pairs file: " << parameters.skippedPairsFile << std::endl;
+				return false;
+			}
+			skippedPairsStream << "Fragment Id" << "\t" << "Model" << "\t" << "GC content" << "\t" << "GC tail probability" << std::endl;
 		}
-		else if(strcmp(argv[p], "--version") == 0)
+	}
+
+	if(bProgressive)
+	{
+		if(bRecordAllModels)
 		{
-			parameters.bShowVersion = true;
-			p += 1;
+			progressStream << "Eliminating models early (-d) requires the top T models to be reported (-t)." << std::endl;
+			return false;
 		}
-		else if(strcmp(argv[p], "--contact") == 0)
+		else if(!bSingleModels || bGCPrune)
 		{
-			parameters.bShowContactInfo = true;
-			p += 1;
+			progressStream << "Eliminating models early (-d) is only supported when dense or canonical models are applied one at a time." << std::endl;
+			return false;
 		}
-		else if(strcmp(argv[p], "-e") == 0)
+	}
+
+	if(bWindows)
+	{
+		if(parameters.windowStep <= 0)
+			parameters.windowStep = std::max(parameters.windowLength / 2, 1);
+
+		if(bPaired)
 		{
-			parameters.tempExtension = argv[p+1];
-			p += 2;
+			progressStream << "Windows (--window) can not be classified for paired-end reads." << std::endl;
+			return false;
 		}
-		else
+
+		if(!bSingleModels || bGCPrune || bProgressive || parameters.bCompactKmers)
 		{
-			std::cout << "Unrecognized parameter: " << argv[p] << std::endl << std::endl;
+			progressStream << "Classifying windows (--window) is only supported when dense or canonical models are applied one at a time to uncollapsed n-mers." << std::endl;
 			return false;
 		}
 	}
@@ -134,15 +1680,6 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 	return true;
 }
 
-struct TopModel
-{
-	TopModel(): modelNum(0), logLikelihood(-1e10) {} 
-	TopModel(uint _modelNum, float _logLikelihood): modelNum(_modelNum), logLikelihood(_logLikelihood) {}
-
-	uint modelNum;
-	float logLikelihood;
-};
-
 int main(int argc, char* argv[])
 {
 	// Parse command-line arguments
@@ -178,278 +1715,491 @@ int main(int argc, char* argv[])
 		parameters.topModels = 0;
 	}
 
+	// results of all models can be written as binary matrices in place of text
+	bool bBinaryResults = (parameters.resultsFormat != "text");
+	BinaryResults binaryResults(parameters.resultsFormat == "float16" ? BinaryResults::FLOAT16_SCORES : BinaryResults::FLOAT32_SCORES);
+	if(bBinaryResults)
+	{
+		if(parameters.resultsFormat != "float32" && parameters.resultsFormat != "float16")
+		{
+			std::cout << "Unrecognized results format: " << parameters.resultsFormat << std::endl;
+			return -1;
+		}
+		else if(!bRecordAllModels)
+		{
+			std::cout << "Binary results (--format) are only written when all models are reported (-t 0)." << std::endl;
+			return -1;
+		}
+	}
+
+	// progress information is written to stderr when results are written to stdout
+	bool bResultsToStdout = (parameters.resultsFile == "-");
+	std::ostream& progressStream = bResultsToStdout ? std::cerr : std::cout;
+
+	if(!isScoringKernelSupported(parameters.scoringKernel))
+	{
+		progressStream << "Instruction set not supported by this CPU: " << scoringKernelName(parameters.scoringKernel) << std::endl;
+		return -1;
+	}
+	KmerModel::scoringKernel(parameters.scoringKernel);
+	ModelBlock::scoringKernel(parameters.scoringKernel);
+
 	// Get model k-mer length
 	if(parameters.verbose >= 1)
-		std::cout << "Determining n-mer length..." << std::endl;
+		progressStream << "Determining n-mer length..." << std::endl;
 
 	std::ifstream tempStream(parameters.modelFile.c_str(), std::ios::in);	
 	if(tempStream.fail())
 	{
-		std::cout << "Failed to open model file: " << parameters.modelFile << std::endl << std::endl;
+		progressStream << "Failed to open model file: " << parameters.modelFile << std::endl << std::endl;
 		return -1;
 	}
 	std::string line;
 	std::getline(tempStream, line);	
 	KmerModel tempModel(line);
+	if(!tempModel.valid())
+		return -1;
+
 	uint kmerLength = tempModel.kmerLength();
+	bool bCanonical = tempModel.canonical();
+	bool bSparse = tempModel.sparse();
+	bool bDelta = tempModel.delta();
 	if(parameters.verbose >= 1)
-		std::cout << "  n-mer length: " << kmerLength << std::endl << std::endl;
-	
-	// Read query fragments
-
+		progressStream << "  n-mer length: " << kmerLength << std::endl;
+	if(parameters.verbose >= 1 && bCanonical)
+		progressStream << "  Models use canonical n-mers." << std::endl;
+	if(parameters.verbose >= 1 && bSparse)
+		progressStream << "  Models are sparse and are applied directly to each query fragment." << std::endl;
+	if(parameters.verbose >= 1 && bDelta)
+		progressStream << "  Models are deltas from a null model and are applied together." << std::endl;
 	if(parameters.verbose >= 1)
-		std::cout << "Reading query fragments..." << std::endl;
-
-	char* buffer = NULL;
-	std::vector<SeqInfo> querySeqs;
+		progressStream << "  Scoring instruction set: " << scoringKernelName(parameters.scoringKernel) << std::endl << std::endl;
+	
+	// Open query fragments and results file
 	FastaIO fastaIO;
-	bool bSuccess = fastaIO.readSeqs(parameters.queryFile, querySeqs, buffer, parameters.verbose);
-	if(!bSuccess)
+	if(!fastaIO.open(parameters.queryFile))
 	{
-		std::cout << "Failed to open query fragment file: " << parameters.queryFile << std::endl;
+		progressStream << "Failed to open query fragment file: " << parameters.queryFile << std::endl;
 		return -1;
 	}
-	if(parameters.verbose >= 1)
-		std::cout << "  Number of query fragments: " << querySeqs.size() << std::endl << std::endl;
+
+	// paired-end reads are classified as one fragment per pair, with second mates in a separate or the same file
+	bool bPaired = !parameters.mateFile.empty() || parameters.bInterleaved;
+	FastaIO mateIO;
+	if(!parameters.mateFile.empty())
+	{
+		if(parameters.bInterleaved)
+		{
+			progressStream << "Mates must either be in a separate file (--mates) or interleaved (--interleaved)." << std::endl;
+			return -1;
+		}
+		else if(!mateIO.open(parameters.mateFile))
+		{
+			progressStream << "Failed to open mate file: " << parameters.mateFile << std::endl;
+			return -1;
+		}
+	}
+
+	std::ofstream resultsFileStream;
+	if(!bResultsToStdout)
+	{
+		resultsFileStream.open(parameters.resultsFile.c_str(), std::ios::out | std::ios::binary);
+		if(resultsFileStream.fail())
+		{
+			progressStream << "Failed to open results file: " << parameters.resultsFile << std::endl;
+			return -1;
+		}
+	}
+	std::ostream& resultsStream = bResultsToStdout ? std::cout : resultsFileStream;
 
 	// Classify query fragments in batches in order to keep memory requirements within reason (~ 1GB)
 	if(parameters.verbose >= 1)
-		std::cout << "Processing query fragments in batches of " << parameters.batchSize << "." << std::endl << std::endl;
+		progressStream << "Processing query fragments in batches of " << parameters.batchSize << "." << std::endl << std::endl;
+
+	// sparse models look up each n-mer of a fragment directly, so they are not applied to stored n-mer profiles
+	if(bSparse && (parameters.bCompactKmers || parameters.bBlocked || parameters.fusedTileSize > 0))
+	{
+		progressStream << "Sparse models can not be applied to collapsed n-mers (-c), in blocks (-s), or in fused tiles (-f)." << std::endl;
+		return -1;
+	}
+
+	// delta models are held in memory and applied together after the null model is applied to each fragment
+	KmerModel* nullModel = NULL;
+	DeltaIndex deltaIndex;
+	std::vector<std::string> deltaModelNames;
+	std::vector<std::string> deltaModelTaxonomies;
+	if(bDelta && !readDeltaModels(parameters, kmerLength, nullModel, deltaIndex, deltaModelNames, deltaModelTaxonomies, progressStream))
+		return -1;
+
+	// a low-rank approximation or low n-mer length prefilter models give approximate log likelihoods for
+	// all models, with the best candidates re-scored exactly, and an exact k-mer index restricts scoring
+	// to models sharing k-mers with each fragment, as do sketches for long fragments and the centroids
+	// of clusters of models
+	CandidateModels candidates(parameters);
+	bool bCandidates = candidates.any();
+	if(bCandidates && !readCandidateModels(parameters, kmerLength, bCanonical, bSparse, bDelta, bRecordAllModels, bBinaryResults, candidates, progressStream))
+		return -1;
+
+	// fragment and model pairs can be skipped when the GC content of the fragment is implausible under the model,
+	// models can be eliminated for a fragment once their partial log likelihood clearly trails the top T models,
+	// and windows along each fragment can be classified in place of whole fragments
+	bool bGCPrune = (parameters.gcTailProbability > 0);
+	bool bProgressive = (parameters.eliminationMargin >= 0);
+	bool bWindows = (parameters.windowLength > 0);
+	bool bSingleModels = !(bSparse || bDelta || bCandidates || parameters.bBlocked || parameters.fusedTileSize > 0);
+	std::ofstream skippedPairsStream;
+	if(!setupSingleModelModes(parameters, bRecordAllModels, bSingleModels, bPaired, skippedPairsStream, progressStream))
+		return -1;
+
+	ulong numSkippedPairs = 0;
+	ulong numSavedLookups = 0;
+	ulong numLookups = 0;
+	std::mt19937 kmerOrderGenerator(12345);
+
+	// blocked mode applies blocks of models to the stored n-mers of all fragments as a matrix product
+	bool bBlocked = (parameters.bBlocked && !bSparse && !bDelta && !bCandidates);
+	bool bFused = (parameters.fusedTileSize > 0 && !bSparse && !bDelta && !bCandidates && !bBlocked);
+	uint tileSize = 1;
+	if(bBlocked)
+		tileSize = MODEL_BLOCK_WIDTH;
+	else if(bFused)
+		tileSize = std::min((uint)parameters.fusedTileSize, MAX_FUSED_TILE_SIZE);
+	ModelBlock modelBlock;
 
 	KmerCalculator kmerCalculator(kmerLength);
-	for(uint batchNum = 0; batchNum < ceil(double(querySeqs.size()) / parameters.batchSize); ++batchNum)
+	FragmentTable queryFragments;
+	KmerProfileArena queryProfiles;
+	KmerCalculator prefilterCalculator(candidates.bCascade ? candidates.prefilterKmerLength : kmerLength);
+	KmerProfileArena prefilterProfiles;
+	FragmentWindows queryWindows;
+	ulong numQuerySeqs = 0;
+	ulong numQueryWindows = 0;
+	for(uint batchNum = 0; ; ++batchNum)
 	{
-		if(parameters.verbose >= 1)
-			std::cout << "Batch #" << (batchNum+1) << std::endl;
+		// read next batch of query fragments
+		if(bPaired)
+		{
+			if(!fastaIO.nextPairs(queryFragments, parameters.batchSize, parameters.bInterleaved ? fastaIO : mateIO))
+				return -1;
+		}
+		else
+			fastaIO.nextSeqs(queryFragments, parameters.batchSize);
+
+		if(fastaIO.error() || (bPaired && mateIO.error()))
+		{
+			progressStream << "Failed to read query file: " << parameters.queryFile << std::endl;
+			return -1;
+		}
+
+		if(queryFragments.size() == 0)
+			break;
+
+		numQuerySeqs += queryFragments.size();
 
-		// get k-mers for each query fragment
 		if(parameters.verbose >= 1)
-			std::cout << "  Calculating n-mers in query fragment: " << std::endl;	
+			progressStream << "Batch #" << (batchNum+1) << " (" << queryFragments.size() << " fragments)" << std::endl;
 
-		std::vector< std::vector<uint> > queryKmerProfiles;
-		queryKmerProfiles.reserve(parameters.batchSize);
-		for(uint seqIndex = batchNum*parameters.batchSize; 
-					seqIndex < std::min(ulong(querySeqs.size()), ulong(batchNum+1)*parameters.batchSize); 
-					++seqIndex)
+		if(parameters.verbose >= 2)
+			progressStream << "  Fragment data: " << queryFragments.memoryUsage() << " bytes" << std::endl;
+
+		// get k-mers for each query fragment unless they are calculated as each model is applied
+		bool bStoreProfiles = !bFused && !bSparse;
+		queryProfiles.clear();
+		prefilterProfiles.clear();
+		if(bStoreProfiles)
+			queryProfiles.reserve(queryFragments.seqStore().size());
+		if(candidates.bCascade)
+			prefilterProfiles.reserve(queryFragments.seqStore().size());
+		std::vector<KmerSpan> queryProfileSpans;
+		if(bStoreProfiles)
 		{
-			if(parameters.verbose >= 3)
-				std::cout << querySeqs.at(seqIndex).seqId << std::endl;
-			else if (seqIndex % 5000 == 0 && parameters.verbose >= 1)
-				std::cout << "." << std::flush;
+			calculateProfiles(parameters, queryFragments, kmerCalculator, bCanonical, bProgressive, kmerOrderGenerator, 
+													candidates.bCascade ? &prefilterCalculator : NULL, queryProfiles, prefilterProfiles, progressStream);
+
+			if(parameters.verbose >= 2)
+				progressStream << "  Profile data: " << queryProfiles.memoryUsage() << " bytes" << std::endl;
 
-			std::vector<uint> profile;
-			kmerCalculator.extractForwardKmers(querySeqs.at(seqIndex), profile);
-			queryKmerProfiles.push_back(profile);
+			queryProfileSpans.reserve(queryProfiles.size());
+			for(uint seqIndex = 0; seqIndex < queryProfiles.size(); ++seqIndex)
+				queryProfileSpans.push_back(queryProfiles.profile(seqIndex));
 		}
-		if(parameters.verbose >= 1)
-			std::cout << std::endl;
+
+		std::vector<float> gcFractions;
+		if(bGCPrune)
+			calculateGCFractions(queryFragments, gcFractions);
+
+		// results are reported for each window in place of each fragment
+		uint numResults = queryFragments.size();
+		if(bWindows)
+		{
+			queryWindows.build(queryFragments, kmerLength, parameters.windowLength, parameters.windowStep);
+			numResults = queryWindows.size();
+			numQueryWindows += numResults;
+
+			if(parameters.verbose >= 1)
+				progressStream << "  Classifying " << numResults << " windows of query fragments." << std::endl;
+		}
+
+		ulong numBatchSkippedPairs = 0;
+		ulong numBatchSavedLookups = 0;
+		std::vector<TopModelPartials> topModelPartials(bProgressive ? queryFragments.size() : 0);
 
 		// apply each model to each query sequence
 		if(parameters.verbose >= 1)
-			std::cout << "  Applying models to query sequences: " << std::endl;
+			progressStream << "  Applying models to query sequences: " << std::endl;
 
 		std::ifstream modelStream(parameters.modelFile.c_str(), std::ios::in);
 
 		uint modelNum = 0;
 
 		std::vector<std::string> modelNames;
-		std::vector< std::list<TopModel> > topModelsPerFragment(queryKmerProfiles.size());		
+		std::vector<std::string> modelTaxonomies;
+		std::vector< std::list<TopModel> > topModelsPerFragment(numResults);		
 		std::vector< std::vector<float> > modelLogLikelihoods;
-		while(!modelStream.eof())
+		std::vector<KmerModel*> modelTile;
+		bool bEndOfModels = false;
+		if(bDelta)
+		{
+			modelNames = deltaModelNames;
+			modelTaxonomies = deltaModelTaxonomies;
+			classifyDelta(*nullModel, deltaIndex, modelNames.size(), queryProfileSpans, parameters.groupSize, bRecordAllModels, 
+										parameters.topModels, modelLogLikelihoods, topModelsPerFragment);
+
+			bEndOfModels = true;
+		}
+		else if(bCandidates)
+		{
+			modelNames = candidates.modelNames;
+			modelTaxonomies = candidates.modelTaxonomies;
+			if(!classifyCandidates(parameters, candidates, queryFragments, queryProfileSpans, prefilterProfiles, kmerLength, bCanonical,
+														bRecordAllModels, modelLogLikelihoods, topModelsPerFragment, progressStream))
+			{
+				return -1;
+			}
+			bEndOfModels = true;
+		}
+
+		while(!bEndOfModels)
 		{
-			std::string line;
-			std::getline(modelStream, line);
+			// read next tile of models
+			while(modelTile.size() < tileSize)
+			{
+				std::string line;
+				std::getline(modelStream, line);
+
+				if(line.empty())
+				{
+					bEndOfModels = true;
+					break;
+				}
+
+				if((modelNum + modelTile.size()) % 200 == 0 && parameters.verbose >= 1)
+					progressStream << " " << (modelNum + modelTile.size()) << std::flush;
+				
+				KmerModel* kmerModel = new KmerModel(line);
+				if(!kmerModel->valid())
+					return -1;
 
-			if(line.empty())
+				if(kmerModel->kmerLength() != kmerLength || kmerModel->canonical() != bCanonical || kmerModel->sparse() != bSparse)
+				{
+					progressStream << "Model " << line << " must have the same n-mer length and format as the first model." << std::endl;
+					return -1;
+				}
+				modelNames.push_back(kmerModel->name());
+				modelTaxonomies.push_back(kmerModel->taxonomy().taxonomyStr());
+				if(parameters.verbose >= 2)
+				{
+					kmerModel->printModelInfo(progressStream);
+					progressStream << std::endl;
+				}
+
+				modelTile.push_back(kmerModel);
+			}
+
+			if(modelTile.empty())
 				break;
 
-			if(modelNum % 200 == 0 && parameters.verbose >= 1)
-				std::cout << " " << modelNum << std::flush;
-			
-			KmerModel kmerModel(line);
-			modelNames.push_back(kmerModel.name());
-			if(parameters.verbose >= 2)
+			std::vector< std::vector<float> > tileLogLikelihoods(modelTile.size());
+			if(bSparse)
+			{
+				for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
+					classifySparse(queryFragments, *modelTile[tileIndex], tileLogLikelihoods[tileIndex]);
+			}
+			else if(bBlocked)
+			{
+				modelBlock.set(modelTile, 0, modelTile.size());
+				modelBlock.classify(queryProfileSpans, parameters.numThreads, tileLogLikelihoods);
+			}
+			else if(bFused)
+				classifyFused(kmerCalculator, queryFragments, modelTile, tileLogLikelihoods);
+			else if(bGCPrune)
+			{
+				for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
+				{
+					numBatchSkippedPairs += classifyGCPruned(*modelTile[tileIndex], queryFragments, gcFractions, queryProfileSpans, 
+																		parameters.groupSize, parameters.gcTailProbability, skippedPairsStream, tileLogLikelihoods[tileIndex]);
+				}
+			}
+			else if(bProgressive)
+			{
+				// models are applied one at a time so each is compared against the top models of all earlier models
+				for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
+				{
+					numBatchSavedLookups += classifyProgressive(*modelTile[tileIndex], modelNum + tileIndex, queryProfileSpans, topModelsPerFragment, 
+																		parameters.topModels, parameters.eliminationMargin, topModelPartials, tileLogLikelihoods[tileIndex]);
+				}
+			}
+			else if(bWindows)
+			{
+				for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
+					classifyWindows(*modelTile[tileIndex], queryProfileSpans, queryWindows, tileLogLikelihoods[tileIndex]);
+			}
+			else
 			{
-				kmerModel.printModelInfo(std::cout);
-				std::cout << std::endl;
+				for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
+					modelTile[tileIndex]->classify(queryProfileSpans, parameters.groupSize, tileLogLikelihoods[tileIndex]);
 			}
 
-			ulong size = 0;
-			if(bRecordAllModels)
-				size = queryKmerProfiles.size();		
-			std::vector<float> logLikelihoods(size);
-			for(uint seqIndex = 0; seqIndex < queryKmerProfiles.size(); ++seqIndex)
+			for(uint tileIndex = 0; tileIndex < modelTile.size(); ++tileIndex)
 			{
-				SeqInfo querySeqInfo = querySeqs[seqIndex + batchNum*parameters.batchSize];	
-				float logLikelihood = kmerModel.classify(querySeqInfo, queryKmerProfiles[seqIndex]);
+				std::vector<float>& logLikelihoods = tileLogLikelihoods[tileIndex];
 
 				// record models with highest log likelihood
 				if(bRecordAllModels)
 				{
-					logLikelihoods[seqIndex] = logLikelihood;
+					modelLogLikelihoods.push_back(logLikelihoods);
 				}
 				else
 				{
-					std::list<TopModel> topModels = topModelsPerFragment.at(seqIndex);
-
-					if(topModels.size() == 0)
-						topModels.push_front(TopModel(modelNum, logLikelihood));
-
-					std::list<TopModel>::iterator it;
-					bool bInserted = false;
-					for(it = topModels.begin(); it != topModels.end(); it++)
+					for(uint seqIndex = 0; seqIndex < logLikelihoods.size(); ++seqIndex)
 					{
-						if(logLikelihood > it->logLikelihood)
-						{
-							topModels.insert(it, TopModel(modelNum, logLikelihood));
-							bInserted = true;
-							break;
-						}
+						if((bGCPrune || bProgressive) && logLikelihoods[seqIndex] == -FLT_MAX)
+							continue;
+
+						updateTopModels(topModelsPerFragment[seqIndex], modelNum, logLikelihoods[seqIndex], parameters.topModels);
 					}
+				}
+			
+				delete modelTile[tileIndex];
+				modelNum++;
+			}
+			modelTile.clear();
+		}
+		if(parameters.verbose >= 1)
+			progressStream << std::endl;
 
-					if((int)topModels.size() < parameters.topModels && !bInserted)
-						topModels.push_back(TopModel(modelNum, logLikelihood));
-					else if((int)topModels.size() > parameters.topModels)
-							topModels.pop_back();
+		if(bGCPrune)
+		{
+			// a fragment is never left without models, so fragments implausible under every model are scored against all of them
+			uint numPrunedFragments;
+			if(!classifyAllPruned(parameters.modelFile, queryProfileSpans, parameters.groupSize, parameters.topModels, topModelsPerFragment, numPrunedFragments))
+				return -1;
 
-					topModelsPerFragment.at(seqIndex) = topModels;
-				}					
+			numSkippedPairs += numBatchSkippedPairs;
+			if(parameters.verbose >= 1)
+			{
+				progressStream << "  Skipped " << numBatchSkippedPairs << " fragment and model pairs based on GC content.";
+				if(numPrunedFragments > 0)
+					progressStream << " All models scored for " << numPrunedFragments << " fragments for which every model was skipped.";
+				progressStream << std::endl;
 			}
+		}
 
-			if(bRecordAllModels)
-				modelLogLikelihoods.push_back(logLikelihoods);	
-		
-			modelNum++;
+		if(bProgressive)
+		{
+			ulong numBatchLookups = 0;
+			for(uint seqIndex = 0; seqIndex < queryProfileSpans.size(); ++seqIndex)
+				numBatchLookups += queryProfileSpans[seqIndex].numKmers * modelNum;
+
+			numSavedLookups += numBatchSavedLookups;
+			numLookups += numBatchLookups;
+			if(parameters.verbose >= 1)
+			{
+				progressStream << "  Saved " << numBatchSavedLookups << " of " << numBatchLookups << " n-mer lookups (" 
+												<< (100.0 * numBatchSavedLookups) / std::max(numBatchLookups, (ulong)1) << "%) by eliminating models early." << std::endl;
+			}
 		}
-		if(parameters.verbose >= 1)
-			std::cout << std::endl;
 
-		// write out classification
+		// write out classification as soon as batch is complete
 		if(parameters.verbose >= 1)
-			std::cout << "  Writing out classification results." << std::endl << std::endl;
+			progressStream << "  Writing out classification results." << std::endl << std::endl;
 
-		std::stringstream outputTempResults;
-		outputTempResults << "./batch_" << batchNum << "." << parameters.tempExtension;		
-		std::ofstream fout(outputTempResults.str().c_str(), std::ios::out);	
-		if(fout.fail())
+		// check if all model results are to be written out
+		if(bBinaryResults)
 		{
-			std::cout << "Failed to write temporary results file: " << outputTempResults.str() << std::endl;
-			return -1;
-		}
+			if(batchNum == 0)
+				binaryResults.writeHeader(resultsStream, modelNames, modelTaxonomies);
 
-		// check if all model results are to be written out
-		if(bRecordAllModels)
+			std::vector<std::string> ids(numResults);
+			std::vector<uint> lengths(numResults);
+			std::vector<uint> validKmers(numResults);
+			for(uint seqIndex = 0; seqIndex < numResults; ++seqIndex)
+			{
+				ulong length, valid;
+				resultsRowInfo(queryFragments, bWindows ? &queryWindows : NULL, bPaired, seqIndex, ids[seqIndex], length, valid);
+				lengths[seqIndex] = (uint)length;
+				validKmers[seqIndex] = (uint)valid;
+			}
+
+			binaryResults.writeBlock(resultsStream, ids, lengths, validKmers, modelLogLikelihoods);
+		}
+		else if(bRecordAllModels)
 		{		
 			if(batchNum == 0)
 			{
-				fout << "Fragment Id" << "\t" << "Length" << "\t" << "Valid n-mers";
+				resultsStream << "Fragment Id" << "\t" << "Length" << "\t" << "Valid n-mers";
 				for(uint modelIndex = 0; modelIndex < modelNames.size(); ++modelIndex)
-					fout << "\t" << modelNames[modelIndex];
-				fout << std::endl;
+					resultsStream << "\t" << modelNames[modelIndex];
+				resultsStream << std::endl;
 			}
 
-			for(uint seqIndex = 0; seqIndex < queryKmerProfiles.size(); ++seqIndex)
+			for(uint seqIndex = 0; seqIndex < numResults; ++seqIndex)
 			{
-				SeqInfo querySeqInfo = querySeqs.at(seqIndex + batchNum*parameters.batchSize);
-
-				fout << querySeqInfo.seqId << "\t" << querySeqInfo.length << "\t" << querySeqInfo.validKmers;
+				writeResultsRow(resultsStream, queryFragments, bWindows ? &queryWindows : NULL, bPaired, seqIndex);
 
 				for(uint modelIndex = 0; modelIndex < modelNames.size(); ++modelIndex)
-					fout << "\t" << modelLogLikelihoods[modelIndex][seqIndex];
-				fout << std::endl;
+					resultsStream << "\t" << modelLogLikelihoods[modelIndex][seqIndex];
+				resultsStream << "\n";
 			}
 		}
 		else
 		{
-			for(uint seqIndex = 0; seqIndex < queryKmerProfiles.size(); ++seqIndex)
+			for(uint seqIndex = 0; seqIndex < numResults; ++seqIndex)
 			{
-				SeqInfo querySeqInfo = querySeqs.at(seqIndex + batchNum*parameters.batchSize);
-
-				fout << querySeqInfo.seqId << "\t" << querySeqInfo.length << "\t" << querySeqInfo.validKmers;
+				writeResultsRow(resultsStream, queryFragments, bWindows ? &queryWindows : NULL, bPaired, seqIndex);
 
 				std::list<TopModel>::iterator it;
 				for(it = topModelsPerFragment.at(seqIndex).begin(); it != topModelsPerFragment.at(seqIndex).end(); it++)
-					fout << "\t" << modelNames[it->modelNum] << "\t" << it->logLikelihood;
+					resultsStream << "\t" << modelNames[it->modelNum] << "\t" << it->logLikelihood;
 			
-				fout << std::endl;
+				resultsStream << "\n";
 			}
 		}
 
-		fout.close();
-	}
-	
-	// free memory allocated to hold query fragment data
-	delete[] buffer;
-
-	// Concatenate result files
-	if(parameters.verbose >= 1)
-		std::cout << "Building results file: ";
-
-	std::ofstream resultsStream(parameters.resultsFile.c_str(), std::ios::out | std::ios::binary);
-	for(uint batchNum = 0; batchNum < ceil(double(querySeqs.size()) / parameters.batchSize); ++batchNum)
-	{
-		if(parameters.verbose >= 1)
-			std::cout << "." << std::flush;
-
-		std::stringstream tempResultFile;
-		tempResultFile << "./batch_" << batchNum  << "." << parameters.tempExtension;		
-		std::ifstream tempStream(tempResultFile.str().c_str(), std::ios::binary);
-		if(tempStream.fail() || tempStream.bad())
-		{
-			std::cout << "Failed to open file: " << tempResultFile.str() << std::endl;
-			return -1;
-		}
-
-		// calculate size of file
-		tempStream.seekg(0, std::ios::end);
-		ulong fileSize = tempStream.tellg();
-		tempStream.seekg(0, std::ios::beg);
-		
-		// write out data in reasonable sized chunks
-		ulong chunkSize = 64*1024*1024;
-		
-		// allocate memory for reading file
-		char* tempBuffer = new char[chunkSize];
-		if(tempBuffer == NULL)
+		resultsStream.flush();
+		if(resultsStream.fail())
 		{
-			std::cout << std::endl << "Failed to allocate memory required by file: " << tempResultFile.str() << std::endl;
+			progressStream << "Failed to write results file: " << parameters.resultsFile << std::endl;
 			return -1;
 		}
-		
-		for(uint chunk = 0; chunk < ceil(float(fileSize) / chunkSize); ++chunk)
-		{
-			ulong currentChunkSize = std::min(chunkSize, fileSize - chunk*chunkSize);
-
-			// read file into buffer
-			tempStream.read(tempBuffer, currentChunkSize);
-			if(tempStream.fail() || tempStream.bad())
-			{
-				std::cout << std::endl << "Failed to read data from " << tempResultFile.str() << std::endl;
-				return -1;
-			}
+	}
 
-			resultsStream.write(tempBuffer, currentChunkSize);
-			resultsStream.flush();
-		}
+	delete nullModel;
 
-		tempStream.close();
-		delete[] tempBuffer;
-	}
-	resultsStream.close();
+	if(!bResultsToStdout)
+		resultsFileStream.close();
 
 	if(parameters.verbose >= 1)
 	{
-		std::cout << std::endl;
-		std::cout << "Done." << std::endl;
-	}
-
-	for(uint batchNum = 0; batchNum < ceil(double(querySeqs.size()) / parameters.batchSize); ++batchNum)
-	{
-		std::stringstream filename;
-		filename << "./batch_" << batchNum  << "." << parameters.tempExtension;
-		std::remove(filename.str().c_str());
+		progressStream << "Number of query " << (bPaired ? "pairs: " : "fragments: ") << numQuerySeqs << std::endl;
+		if(bWindows)
+			progressStream << "Number of windows classified: " << numQueryWindows << std::endl;
+		if(bGCPrune)
+			progressStream << "Number of fragment and model pairs skipped based on GC content: " << numSkippedPairs << std::endl;
+		if(bProgressive)
+			progressStream << "Number of n-mer lookups saved by eliminating models early: " << numSavedLookups << " of " << numLookups << std::endl;
+		progressStream << "Done." << std::endl;
 	}
 	
 	return 0;
 }
-
@@ -0,0 +1,478 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include <random>
+
+#include "KmerModel.hpp"
+#include "Utils.hpp"
+
+struct Parameters
+{
+	bool bShowHelp, bShowVersion, bShowContactInfo;
+	std::string modelFile, outputDir, distance;
+	int numClusters, iterations, verbose;
+};
+
+void help()
+{
+	std::cout << "Naive Bayes Cluster v1.0.7" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Usage: [options] -m <model-file> -o <output-dir>" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Required parameters:" << std::endl;
+	std::cout << "  <model-file>   File indicating models to cluster." << std::endl;
+	std::cout << "  <output-dir>   Directory to store the centroid model of each cluster and the" << std::endl;
+	std::cout << "                   cluster file (clusters.txt) listing the members of each cluster." << std::endl;
+	std::cout << std::endl;
+	std::cout << "Optional parameters:" << std::endl;
+	std::cout << "  --help        Print help message." << std::endl;
+	std::cout << "  --version     Print version information." << std::endl;
+	std::cout << "  --contact     Print contact information." << std::endl;
+	std::cout << "  -k <integer>  Number of clusters (default = square root of the number of models)." << std::endl;
+	std::cout << "  -d <string>   Divergence between models: kl or l2 (default = kl)." << std::endl;
+	std::cout << "  -i <integer>  Maximum number of iterations (default = 20)." << std::endl;
+	std::cout << "  -v <integer>  Level of output information (default = 1)." << std::endl;
+	std::cout << std::endl;
+	std::cout << "Typical usage:" << std::endl;
+	std::cout << "  nb-cluster -m models.txt -o ./clusters/" << std::endl;
+	std::cout << "  nb-classify -q test.fasta -m models.txt -j ./clusters/clusters.txt -t 1 -r nb_results.txt" << std::endl << std::endl;
+}
+
+// true if the option at position p is followed by a value
+bool hasValue(int argc, char* argv[], int p)
+{
+	if(p + 1 < argc)
+		return true;
+
+	std::cout << "Missing value for parameter: " << argv[p] << std::endl << std::endl;
+	return false;
+}
+
+bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
+{
+	// set default values
+	parameters.bShowHelp = false;
+	parameters.bShowContactInfo = false;
+	parameters.bShowVersion = false;
+	parameters.numClusters = 0;
+	parameters.distance = "kl";
+	parameters.iterations = 20;
+	parameters.verbose = 1;
+
+	// parse parameters
+	int p = 1;
+	while(p < argc)
+	{
+		if(strcmp(argv[p], "-m") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.modelFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-o") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.outputDir = argv[p+1];
+
+			char lastChar = parameters.outputDir[strlen(parameters.outputDir.c_str())-1];
+			if(lastChar != '/' && lastChar != '\\')
+				parameters.outputDir += '/';
+
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-k") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.numClusters = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-d") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.distance = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-i") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.iterations = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-v") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.verbose = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--help") == 0)
+		{
+			parameters.bShowHelp = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--version") == 0)
+		{
+			parameters.bShowVersion = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--contact") == 0)
+		{
+			parameters.bShowContactInfo = true;
+			p += 1;
+		}
+		else
+		{
+			std::cout << "Unrecognized parameter: " << argv[p] << std::endl << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Centroids of clusters of models along with the divergence used to assign models to them. With KL, the 
+// divergence of model probabilities p from centroid probabilities c is sum_i p_i log(p_i / c_i) - p_i + c_i, 
+// which is minimized over the members of a cluster by the mean of their probabilities. The centroid is then
+// the mixture of its members and remains a model that can be applied to fragments. With L2, the distance 
+// between log probability tables is minimized by the mean of the member tables. In both cases the centroid
+// is the mean of the transformed member tables (probabilities for KL, log probabilities for L2).
+class Centroids
+{
+public:
+	Centroids(uint numClusters, ulong tableSize, bool bKL)
+		: m_logProb(numClusters, std::vector<float>(tableSize)), m_bKL(bKL), m_norm(numClusters, 0) {}
+
+	uint size() const { return m_logProb.size(); }
+	const std::vector<float>& logProb(uint cluster) const { return m_logProb[cluster]; }
+
+	void set(uint cluster, const float* logProb)
+	{
+		m_logProb[cluster].assign(logProb, logProb + m_logProb[cluster].size());
+		updateNorm(cluster);
+	}
+
+	void setMean(uint cluster, const std::vector<double>& sum, uint numMembers)
+	{
+		for(ulong i = 0; i < sum.size(); ++i)
+			m_logProb[cluster][i] = (float)(m_bKL ? log(sum[i] / numMembers) : sum[i] / numMembers);
+		updateNorm(cluster);
+	}
+
+	// table of a model as it is averaged into centroids
+	void transform(const float* logProb, std::vector<float>& table) const
+	{
+		for(ulong i = 0; i < table.size(); ++i)
+			table[i] = m_bKL ? exp(logProb[i]) : logProb[i];
+	}
+
+	// divergence of a model from each centroid, returning the nearest centroid
+	uint nearest(const float* logProb, const std::vector<float>& table, double& divergence) const
+	{
+		// terms depending only on the model
+		double modelTerm = 0;
+		for(ulong i = 0; i < table.size(); ++i)
+			modelTerm += m_bKL ? table[i] * (logProb[i] - 1.0) : (double)logProb[i] * logProb[i];
+
+		uint best = 0;
+		divergence = DBL_MAX;
+		for(uint c = 0; c < m_logProb.size(); ++c)
+		{
+			const float* centroid = &m_logProb[c][0];
+			double dot = 0;
+			for(ulong i = 0; i < table.size(); ++i)
+				dot += table[i] * centroid[i];
+
+			double d = m_bKL ? modelTerm - dot + m_norm[c] : modelTerm - 2*dot + m_norm[c];
+			if(d < divergence)
+			{
+				divergence = d;
+				best = c;
+			}
+		}
+
+		return best;
+	}
+
+private:
+	// terms depending only on the centroid: total probability for KL and squared norm for L2
+	void updateNorm(uint cluster)
+	{
+		double norm = 0;
+		const std::vector<float>& logProb = m_logProb[cluster];
+		for(ulong i = 0; i < logProb.size(); ++i)
+			norm += m_bKL ? exp((double)logProb[i]) : (double)logProb[i] * logProb[i];
+		m_norm[cluster] = norm;
+	}
+
+private:
+	std::vector< std::vector<float> > m_logProb;
+	bool m_bKL;
+	std::vector<double> m_norm;
+};
+
+int main(int argc, char* argv[])
+{
+	// Parse command-line arguments
+	Parameters parameters;
+	bool bParsed = parseCommandLine(argc, argv, parameters);
+
+	if(!bParsed || parameters.bShowHelp || argc == 1) 
+	{			
+		help();	
+		return 0;
+	}
+	else if(parameters.bShowVersion)
+	{
+		std::cout << "Naive Bayes Cluster v1.0.7 by Donovan Parks, Norm MacDonald, and Rob Beiko." << std::endl;
+		return 0;
+	}
+	else if(parameters.bShowContactInfo)
+	{
+		std::cout << "Comments, suggestions, and bug reports can be sent to Donovan Parks (donovan.parks@gmail.com)." << std::endl;
+		return 0;
+	}
+	else if(parameters.modelFile.empty() || parameters.outputDir.empty())
+	{
+		std::cout << "Must specify model file (-m) and output directory (-o)." << std::endl << std::endl;
+		help();
+		return 0;
+	}
+	else if(parameters.distance != "kl" && parameters.distance != "l2")
+	{
+		std::cout << "Unrecognized divergence: " << parameters.distance << std::endl;
+		return -1;
+	}
+	else if(parameters.numClusters < 0 || parameters.iterations < 1)
+	{
+		std::cout << "Number of clusters can not be negative and at least 1 iteration is required." << std::endl;
+		return -1;
+	}
+
+	// the cluster file is opened before clustering so a missing or unwritable output directory is reported immediately
+	std::ofstream clusterStream((parameters.outputDir + "clusters.txt").c_str(), std::ios::out);
+	if(clusterStream.fail())
+	{
+		std::cout << "Failed to write cluster file: " << parameters.outputDir << "clusters.txt" << std::endl;
+		std::cout << "The output directory (-o) must exist and be writable." << std::endl;
+		return -1;
+	}
+
+	// read list of models and determine their n-mer length and format
+	std::vector<std::string> modelFiles;
+	std::ifstream modelStream(parameters.modelFile.c_str(), std::ios::in);
+	if(modelStream.fail())
+	{
+		std::cout << "Failed to open model file: " << parameters.modelFile << std::endl;
+		return -1;
+	}
+
+	while(true)
+	{
+		std::string line;
+		std::getline(modelStream, line);
+		if(line.empty())
+			break;
+		modelFiles.push_back(line);
+	}
+
+	if(modelFiles.size() < 2)
+	{
+		std::cout << "At least 2 models are required." << std::endl;
+		return -1;
+	}
+
+	uint numModels = modelFiles.size();
+	uint numClusters = parameters.numClusters > 0 ? parameters.numClusters : (uint)(sqrt((double)numModels) + 0.5);
+	numClusters = std::min(numClusters, numModels);
+
+	// initial centroids are distinct models selected at random
+	if(parameters.verbose >= 1)
+		std::cout << "Selecting " << numClusters << " initial centroids from " << numModels << " models..." << std::endl;
+
+	std::mt19937 generator(12345);
+	std::vector<uint> modelOrder(numModels);
+	for(uint m = 0; m < numModels; ++m)
+		modelOrder[m] = m;
+	std::shuffle(modelOrder.begin(), modelOrder.end(), generator);
+
+	uint kmerLength = 0;
+	bool bCanonical = false;
+	Centroids* centroids = NULL;
+	for(uint c = 0; c < numClusters; ++c)
+	{
+		KmerModel kmerModel(modelFiles[modelOrder[c]]);
+		if(!kmerModel.valid())
+			return -1;
+		else if(kmerModel.sparse() || kmerModel.delta())
+		{
+			std::cout << "Only dense and canonical models can be clustered: " << modelFiles[modelOrder[c]] << std::endl;
+			return -1;
+		}
+
+		if(c == 0)
+		{
+			kmerLength = kmerModel.kmerLength();
+			bCanonical = kmerModel.canonical();
+			centroids = new Centroids(numClusters, kmerModel.tableSize(), parameters.distance == "kl");
+		}
+		else if(kmerModel.kmerLength() != kmerLength || kmerModel.canonical() != bCanonical)
+		{
+			std::cout << "Model " << modelFiles[modelOrder[c]] << " must have the same n-mer length and format as the first model." << std::endl;
+			return -1;
+		}
+
+		centroids->set(c, kmerModel.logConditionalProb());
+	}
+	ulong tableSize = centroids->logProb(0).size();
+
+	// Lloyd iterations, where models are read from disk for every pass so memory requirements grow
+	// with the number of clusters rather than the number of models
+	std::vector<uint> assignments(numModels, numClusters);
+	std::vector<double> divergences(numModels, 0);
+	std::vector<float> table(tableSize);
+	for(int iter = 0; iter < parameters.iterations; ++iter)
+	{
+		std::vector< std::vector<double> > sums(numClusters, std::vector<double>(tableSize, 0.0));
+		std::vector<uint> clusterSizes(numClusters, 0);
+		uint numChanged = 0;
+		double totalDivergence = 0;
+		for(uint m = 0; m < numModels; ++m)
+		{
+			KmerModel kmerModel(modelFiles[m]);
+			if(!kmerModel.valid())
+				return -1;
+			else if(kmerModel.sparse() || kmerModel.delta() || kmerModel.kmerLength() != kmerLength || kmerModel.canonical() != bCanonical)
+			{
+				std::cout << "Model " << modelFiles[m] << " must be a dense or canonical model with the same n-mer length and format as the first model." << std::endl;
+				return -1;
+			}
+
+			const float* logProb = kmerModel.logConditionalProb();
+			centroids->transform(logProb, table);
+			uint cluster = centroids->nearest(logProb, table, divergences[m]);
+			totalDivergence += divergences[m];
+
+			if(cluster != assignments[m])
+				numChanged++;
+			assignments[m] = cluster;
+
+			std::vector<double>& sum = sums[cluster];
+			for(ulong i = 0; i < tableSize; ++i)
+				sum[i] += table[i];
+			clusterSizes[cluster]++;
+		}
+
+		if(parameters.verbose >= 1)
+		{
+			std::cout << "  Iteration " << (iter+1) << ": " << numChanged << " models changed cluster, mean divergence = " 
+								<< totalDivergence / numModels << std::endl;
+		}
+
+		if(numChanged == 0)
+			break;
+
+		// empty clusters are reseeded with the models furthest from their centroid
+		std::vector<uint> furthestModels(numModels);
+		for(uint m = 0; m < numModels; ++m)
+			furthestModels[m] = m;
+		std::sort(furthestModels.begin(), furthestModels.end(), [&divergences](uint a, uint b) { return divergences[a] > divergences[b]; });
+
+		uint nextFurthest = 0;
+		for(uint c = 0; c < numClusters; ++c)
+		{
+			if(clusterSizes[c] > 0)
+				centroids->setMean(c, sums[c], clusterSizes[c]);
+			else
+			{
+				KmerModel kmerModel(modelFiles[furthestModels[nextFurthest++]]);
+				if(!kmerModel.valid())
+					return -1;
+
+				centroids->set(c, kmerModel.logConditionalProb());
+			}
+		}
+	}
+
+	// write centroid of each non-empty cluster and the cluster file
+	if(parameters.verbose >= 1)
+		std::cout << "Writing centroid models..." << std::endl;
+
+	uint numWritten = 0;
+	uint largestCluster = 0;
+	for(uint c = 0; c < numClusters; ++c)
+	{
+		uint clusterSize = std::count(assignments.begin(), assignments.end(), c);
+		if(clusterSize == 0)
+			continue;
+		largestCluster = std::max(largestCluster, clusterSize);
+
+		// centroid models are listed relative to the cluster file so the output directory can be moved
+		std::string centroidName = "cluster_" + numberToStr(numWritten);
+		KmerModel centroid(kmerLength, bCanonical ? KmerModel::CANONICAL_MODEL : KmerModel::DENSE_MODEL);
+		centroid.name(centroidName);
+		centroid.logConditionalProb(&centroids->logProb(c)[0]);
+		centroid.write(parameters.outputDir + centroidName + ".txt");
+
+		for(uint m = 0; m < numModels; ++m)
+		{
+			if(assignments[m] == c)
+				clusterStream << centroidName << ".txt" << "\t" << modelFiles[m] << std::endl;
+		}
+
+		numWritten++;
+	}
+	delete centroids;
+
+	clusterStream.close();
+	if(clusterStream.fail())
+	{
+		std::cout << "Failed to write cluster file: " << parameters.outputDir << "clusters.txt" << std::endl;
+		return -1;
+	}
+
+	if(parameters.verbose >= 1)
+	{
+		double totalDivergence = 0;
+		for(uint m = 0; m < numModels; ++m)
+			totalDivergence += divergences[m];
+
+		std::cout << std::endl;
+		std::cout << "Number of models: " << numModels << std::endl;
+		std::cout << "Number of clusters: " << numWritten << std::endl;
+		std::cout << "Largest cluster: " << largestCluster << " models" << std::endl;
+		std::cout << "Mean divergence of models from their centroid: " << totalDivergence / numModels << std::endl;
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "BinaryResults.hpp"
+
+void BinaryResults::writePadding(std::ostream& out, ulong bytesWritten)
+{
+	static const char zeros[8] = { 0 };
+	if(bytesWritten % 8 != 0)
+		out.write(zeros, 8 - bytesWritten % 8);
+}
+
+void BinaryResults::writeHeader(std::ostream& out, const std::vector<std::string>& modelNames, const std::vector<std::string>& modelTaxonomies) const
+{
+	out.write("NBRB", 4);
+
+	uint fields[3] = { FORMAT_VERSION, (uint)m_format, (uint)modelNames.size() };
+	out.write((char*)fields, sizeof(fields));
+
+	ulong bytesWritten = 4 + sizeof(fields);
+	for(uint modelIndex = 0; modelIndex < modelNames.size(); ++modelIndex)
+	{
+		const std::string& taxonomy = modelIndex < modelTaxonomies.size() ? modelTaxonomies[modelIndex] : std::string();
+
+		uint size = modelNames[modelIndex].size();
+		out.write((char*)&size, sizeof(uint));
+		out.write(modelNames[modelIndex].c_str(), size);
+
+		uint taxonomySize = taxonomy.size();
+		out.write((char*)&taxonomySize, sizeof(uint));
+		out.write(taxonomy.c_str(), taxonomySize);
+
+		bytesWritten += 2*sizeof(uint) + size + taxonomySize;
+	}
+
+	writePadding(out, bytesWritten);
+}
+
+void BinaryResults::writeBlock(std::ostream& out, const std::vector<std::string>& fragmentIds, const std::vector<uint>& lengths, 
+																const std::vector<uint>& validKmers, const std::vector< std::vector<float> >& modelLogLikelihoods) const
+{
+	uint numFragments = fragmentIds.size();
+	uint numModels = modelLogLikelihoods.size();
+
+	uint idBytes = 0;
+	for(uint seqIndex = 0; seqIndex < numFragments; ++seqIndex)
+		idBytes += fragmentIds[seqIndex].size() + 1;
+	ulong paddedIdBytes = (idBytes + 7) & ~ulong(7);
+
+	ulong scoreBytes = (ulong)numFragments * numModels * (m_format == FLOAT16_SCORES ? sizeof(unsigned short) : sizeof(float));
+	ulong blockSize = sizeof(uint64) + 2*sizeof(uint) + paddedIdBytes + (ulong)numFragments * 3 * sizeof(uint) + scoreBytes;
+	uint64 paddedBlockSize = (blockSize + 7) & ~uint64(7);
+
+	out.write((char*)&paddedBlockSize, sizeof(uint64));
+	out.write((char*)&numFragments, sizeof(uint));
+	out.write((char*)&idBytes, sizeof(uint));
+	for(uint seqIndex = 0; seqIndex < numFragments; ++seqIndex)
+		out.write(fragmentIds[seqIndex].c_str(), fragmentIds[seqIndex].size() + 1);
+	writePadding(out, idBytes);
+
+	out.write((char*)&lengths[0], numFragments * sizeof(uint));
+	out.write((char*)&validKmers[0], numFragments * sizeof(uint));
+
+	// highest log likelihood of each fragment
+	std::vector<float> bestLogLikelihoods(numFragments, -FLT_MAX);
+	for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+	{
+		for(uint seqIndex = 0; seqIndex < numFragments; ++seqIndex)
+			bestLogLikelihoods[seqIndex] = std::max(bestLogLikelihoods[seqIndex], modelLogLikelihoods[modelIndex][seqIndex]);
+	}
+	out.write((char*)&bestLogLikelihoods[0], numFragments * sizeof(float));
+
+	// scores are transposed to fragment-major order one fragment at a time
+	std::vector<float> row(numModels);
+	std::vector<unsigned short> halfRow(numModels);
+	for(uint seqIndex = 0; seqIndex < numFragments; ++seqIndex)
+	{
+		if(m_format == FLOAT16_SCORES)
+		{
+			for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+				halfRow[modelIndex] = floatToHalf(modelLogLikelihoods[modelIndex][seqIndex] - bestLogLikelihoods[seqIndex]);
+			out.write((char*)&halfRow[0], numModels * sizeof(unsigned short));
+		}
+		else
+		{
+			for(uint modelIndex = 0; modelIndex < numModels; ++modelIndex)
+				row[modelIndex] = modelLogLikelihoods[modelIndex][seqIndex];
+			out.write((char*)&row[0], numModels * sizeof(float));
+		}
+	}
+
+	writePadding(out, blockSize);
+}
+
+unsigned short BinaryResults::floatToHalf(float value)
+{
+	uint bits;
+	memcpy(&bits, &value, sizeof(float));
+
+	unsigned short sign = (bits >> 16) & 0x8000;
+	uint magnitude = bits & 0x7FFFFFFF;
+
+	if(magnitude > 0x7F800000)
+		return sign | 0x7E00;		// NaN
+
+	// saturate at the largest finite half (65504), including infinities
+	if(magnitude >= 0x477FF000)
+		return sign | 0x7BFF;
+
+	// normal halves, rounding the 13 dropped mantissa bits to nearest even
+	if(magnitude >= 0x38800000)
+	{
+		uint half = (magnitude - 0x38000000) >> 13;
+		uint dropped = magnitude & 0x1FFF;
+		if(dropped > 0x1000 || (dropped == 0x1000 && (half & 1)))
+			++half;
+		return sign | (unsigned short)half;
+	}
+
+	// subnormal halves, in units of 2^-24
+	if(magnitude < 0x33000000)
+		return sign;
+
+	uint exponent = magnitude >> 23;
+	uint mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+	uint shift = 126 - exponent;
+	uint half = mantissa >> shift;
+	uint dropped = mantissa & ((1 << shift) - 1);
+	uint halfway = 1 << (shift - 1);
+	if(dropped > halfway || (dropped == halfway && (half & 1)))
+		++half;
+
+	return sign | (unsigned short)half;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef BINARY_RESULTS
+#define BINARY_RESULTS
+
+#include "stdafx.h"
+
+// Writes the log likelihood of every model for each fragment (T = 0) in a binary format that can be
+// memory mapped and scanned without parsing. All values are little-endian.
+//
+// Header:
+//   char[4]      "NBRB"
+//   uint32       format version (1)
+//   uint32       score format (0 = float32, 1 = float16)
+//   uint32       number of models M
+//   per model:   uint32 length and characters of the model name, then of its taxonomy (may be empty)
+//   padding to a multiple of 8 bytes
+//
+// One block per batch of N fragments, each starting at a multiple of 8 bytes:
+//   uint64       size of block in bytes, including this field
+//   uint32       number of fragments N
+//   uint32       bytes of fragment ids
+//   char[]       null-terminated fragment ids, padded to a multiple of 8 bytes
+//   uint32[N]    length of each fragment
+//   uint32[N]    valid n-mers of each fragment
+//   float32[N]   highest log likelihood of each fragment
+//   scores[N*M]  log likelihoods in fragment-major order, padded to a multiple of 8 bytes
+//
+// With float32 scores the log likelihoods are stored exactly. With float16 scores each log likelihood 
+// is stored as its difference from the highest log likelihood of the fragment, which preserves 
+// resolution where it matters for classification. Differences beyond the float16 range are saturated.
+class BinaryResults
+{
+public:
+	enum SCORE_FORMAT { FLOAT32_SCORES = 0, FLOAT16_SCORES = 1 };
+
+	static const uint FORMAT_VERSION = 1;
+
+public:
+	BinaryResults(SCORE_FORMAT format): m_format(format) {}
+
+	void writeHeader(std::ostream& out, const std::vector<std::string>& modelNames, const std::vector<std::string>& modelTaxonomies) const;
+
+	// log likelihoods are given for each model and fragment, as recorded by nb-classify
+	void writeBlock(std::ostream& out, const std::vector<std::string>& fragmentIds, const std::vector<uint>& lengths, 
+										const std::vector<uint>& validKmers, const std::vector< std::vector<float> >& modelLogLikelihoods) const;
+
+	// IEEE half precision value nearest to a float, saturating at the largest finite half
+	static unsigned short floatToHalf(float value);
+
+private:
+	static void writePadding(std::ostream& out, ulong bytesWritten);
+
+private:
+	SCORE_FORMAT m_format;
+};
+
+#endif
\ No newline at end of file
@@ -25,6 +25,7 @@
 typedef unsigned char byte;
 typedef unsigned int uint;
 typedef unsigned long ulong;
+typedef unsigned long long uint64;
 
 const uint NUM_TAXONOMIC_RANKS = 7;
 enum TAXONOMIC_RANK { SUPERKINGDOM_RANK, PHYLUM_RANK, CLASS_RANK, ORDER_RANK, FAMILY_RANK, GENUS_RANK, SPECIES_RANK, STRAIN_RANK };
@@ -80,4 +81,19 @@ struct SeqInfo
 	ulong validKmers;
 };
 
+// Non-owning view of the k-mers extracted from a sequence. A compacted profile
+// holds each distinct k-mer once along with its number of occurrences.
+struct KmerSpan
+{
+	KmerSpan(): kmers(NULL), counts(NULL), numKmers(0) {}
+	KmerSpan(const uint* _kmers, ulong _numKmers): kmers(_kmers), counts(NULL), numKmers(_numKmers) {}
+	KmerSpan(const std::vector<uint>& kmerValues): kmers(kmerValues.empty() ? NULL : &kmerValues[0]), counts(NULL), numKmers(kmerValues.size()) {}
+	KmerSpan(const std::vector<uint>& kmerValues, const std::vector<uint>& kmerCounts)
+		: kmers(kmerValues.empty() ? NULL : &kmerValues[0]), counts(kmerCounts.empty() ? NULL : &kmerCounts[0]), numKmers(kmerValues.size()) {}
+
+	const uint* kmers;
+	const uint* counts;
+	ulong numKmers;
+};
+
 #endif
\ No newline at end of file
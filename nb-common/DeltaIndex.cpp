@@ -0,0 +1,86 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "DeltaIndex.hpp"
+
+DeltaIndex::DeltaIndex()
+{
+	clear();
+}
+
+void DeltaIndex::clear()
+{
+	m_numModels = 0;
+	m_postingKmers.clear();
+	m_offsets.clear();
+	m_postings.clear();
+}
+
+uint DeltaIndex::add(const KmerModel& kmerModel)
+{
+	for(ulong i = 0; i < kmerModel.numDeltas(); ++i)
+	{
+		m_postingKmers.push_back((uint)kmerModel.deltaKmer(i));
+		m_postings.push_back(Posting(m_numModels, kmerModel.deltaLogProb(i)));
+	}
+
+	return m_numModels++;
+}
+
+void DeltaIndex::build(uint kmerLength)
+{
+	// counting sort of postings by k-mer, which keeps postings of each k-mer in model order
+	ulong numPossibleWords = 1ULL << (2*kmerLength);
+	m_offsets.assign(numPossibleWords + 1, 0);
+	for(ulong i = 0; i < m_postingKmers.size(); ++i)
+		m_offsets[m_postingKmers[i] + 1]++;
+
+	for(ulong i = 0; i < numPossibleWords; ++i)
+		m_offsets[i + 1] += m_offsets[i];
+
+	std::vector<uint> next(m_offsets.begin(), m_offsets.end() - 1);
+	std::vector<Posting> postings(m_postings.size());
+	for(ulong i = 0; i < m_postingKmers.size(); ++i)
+		postings[next[m_postingKmers[i]]++] = m_postings[i];
+
+	m_postings.swap(postings);
+	std::vector<uint>().swap(m_postingKmers);
+}
+
+void DeltaIndex::score(const KmerSpan& profile, float* logLikelihoods) const
+{
+	const uint* offsets = &m_offsets[0];
+	const Posting* postings = m_postings.empty() ? NULL : &m_postings[0];
+	for(ulong i = 0; i < profile.numKmers; ++i)
+	{
+		uint kmer = profile.kmers[i];
+		float count = profile.counts ? (float)profile.counts[i] : 1.0f;
+		for(uint p = offsets[kmer]; p < offsets[kmer + 1]; ++p)
+			logLikelihoods[postings[p].modelIndex] += count * postings[p].delta;
+	}
+}
+
+ulong DeltaIndex::memoryUsage() const
+{
+	return m_postingKmers.size()*sizeof(uint) + m_offsets.size()*sizeof(uint) + m_postings.size()*sizeof(Posting);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef DELTA_INDEX
+#define DELTA_INDEX
+
+#include "stdafx.h"
+
+#include "KmerModel.hpp"
+
+// Inverted index over the differences between a set of delta models and their null model. The 
+// postings for each k-mer list the models whose log probability for the k-mer differs substantially 
+// from the null model. The log likelihood of a fragment under a model is the log likelihood under the 
+// null model plus the sum of the model's differences over the k-mers of the fragment, so the cost of 
+// applying all models grows with the number of differences rather than the number of models.
+class DeltaIndex
+{
+public:
+	DeltaIndex();
+
+	void clear();
+
+	// add differences of a delta model, returning the index of the model
+	uint add(const KmerModel& kmerModel);
+
+	// arrange postings by k-mer once all models have been added
+	void build(uint kmerLength);
+
+	uint numModels() const { return m_numModels; }
+	ulong numPostings() const { return m_postings.size(); }
+
+	// add differences of each model over the k-mers of a profile to the given log likelihoods
+	void score(const KmerSpan& profile, float* logLikelihoods) const;
+
+	ulong memoryUsage() const;
+
+private:
+	struct Posting
+	{
+		Posting() {}
+		Posting(uint _modelIndex, float _delta): modelIndex(_modelIndex), delta(_delta) {}
+
+		uint modelIndex;
+		float delta;
+	};
+
+	uint m_numModels;
+
+	// k-mer of each posting prior to the index being built
+	std::vector<uint> m_postingKmers;
+
+	// postings of k-mer i are in [m_offsets[i], m_offsets[i+1])
+	std::vector<uint> m_offsets;
+	std::vector<Posting> m_postings;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,409 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "ExactKmerIndex.hpp"
+#include "Utils.hpp"
+
+const uint ExactKmerIndex::DEFAULT_MINIMIZER_LENGTH;
+
+ExactKmerIndex::ExactKmerIndex()
+	: m_kmerLength(0), m_minimizerLength(0), m_kmerCalculator(NULL), m_numBuckets(1)
+{
+	kmerLength(DEFAULT_KMER_LENGTH);
+}
+
+ExactKmerIndex::~ExactKmerIndex()
+{
+	delete m_kmerCalculator;
+}
+
+void ExactKmerIndex::clear()
+{
+	m_strainNames.clear();
+	m_strainKmers.clear();
+	m_entries.clear();
+
+	m_numBuckets = 1;
+	m_bucketOffsets.assign(2, 0);
+	m_kmers.clear();
+	m_kmerSets.clear();
+
+	m_setOffsets.assign(1, 0);
+	m_setStrains.clear();
+}
+
+void ExactKmerIndex::kmerLength(uint kmerLength)
+{
+	clear();
+
+	m_kmerLength = kmerLength;
+	m_minimizerLength = std::min(kmerLength, DEFAULT_MINIMIZER_LENGTH);
+
+	delete m_kmerCalculator;
+	m_kmerCalculator = new KmerCalculator(kmerLength);
+}
+
+uint ExactKmerIndex::addStrain(const std::string& name)
+{
+	flushStrain();
+
+	m_strainNames.push_back(name);
+	return m_strainNames.size() - 1;
+}
+
+void ExactKmerIndex::add(SeqInfo& seqInfo)
+{
+	// k-mers are extracted in pairs of a k-mer and its reverse complement
+	m_kmerBuffer.clear();
+	m_kmerCalculator->extractKmers(seqInfo, m_kmerBuffer);
+	for(ulong i = 0; i + 1 < m_kmerBuffer.size(); i += 2)
+		m_strainKmers.push_back(std::min(m_kmerBuffer[i], m_kmerBuffer[i+1]));
+}
+
+void ExactKmerIndex::flushStrain()
+{
+	// each k-mer is recorded once per strain
+	std::sort(m_strainKmers.begin(), m_strainKmers.end());
+	std::vector<uint64>::iterator last = std::unique(m_strainKmers.begin(), m_strainKmers.end());
+	for(std::vector<uint64>::iterator it = m_strainKmers.begin(); it != last; ++it)
+		m_entries.push_back(Entry(*it, m_strainNames.size() - 1));
+
+	std::vector<uint64>().swap(m_strainKmers);
+}
+
+void ExactKmerIndex::build()
+{
+	flushStrain();
+	std::vector<uint64>().swap(m_kmerBuffer);
+
+	// strain set of each distinct k-mer, with identical strain sets stored once
+	std::sort(m_entries.begin(), m_entries.end());
+
+	std::map<std::vector<uint>, uint> setIndices;
+	std::vector<uint64> kmers;
+	std::vector<uint> kmerSets;
+	std::vector<uint> strains;
+	m_setOffsets.assign(1, 0);
+	m_setStrains.clear();
+	for(ulong i = 0; i < m_entries.size(); )
+	{
+		strains.clear();
+		ulong j = i;
+		for(; j < m_entries.size() && m_entries[j].kmer == m_entries[i].kmer; ++j)
+			strains.push_back(m_entries[j].strainIndex);
+
+		std::map<std::vector<uint>, uint>::iterator setIt = setIndices.find(strains);
+		if(setIt == setIndices.end())
+		{
+			setIt = setIndices.insert(std::make_pair(strains, (uint)m_setOffsets.size() - 1)).first;
+			m_setStrains.insert(m_setStrains.end(), strains.begin(), strains.end());
+			m_setOffsets.push_back(m_setStrains.size());
+		}
+
+		kmers.push_back(m_entries[i].kmer);
+		kmerSets.push_back(setIt->second);
+
+		i = j;
+	}
+	std::vector<Entry>().swap(m_entries);
+
+	// counting sort of k-mers by bucket, which keeps the k-mers of each bucket in ascending order
+	m_numBuckets = 1;
+	while(m_numBuckets * 16 < kmers.size())
+		m_numBuckets <<= 1;
+
+	std::vector<uint> kmerBuckets(kmers.size());
+	m_bucketOffsets.assign(m_numBuckets + 1, 0);
+	for(ulong i = 0; i < kmers.size(); ++i)
+	{
+		kmerBuckets[i] = (uint)bucket(kmers[i], m_kmerCalculator->reverseComplement(kmers[i]));
+		m_bucketOffsets[kmerBuckets[i] + 1]++;
+	}
+
+	for(uint64 i = 0; i < m_numBuckets; ++i)
+		m_bucketOffsets[i + 1] += m_bucketOffsets[i];
+
+	std::vector<uint64> next(m_bucketOffsets.begin(), m_bucketOffsets.end() - 1);
+	m_kmers.resize(kmers.size());
+	m_kmerSets.resize(kmers.size());
+	for(ulong i = 0; i < kmers.size(); ++i)
+	{
+		uint64 pos = next[kmerBuckets[i]]++;
+		m_kmers[pos] = kmers[i];
+		m_kmerSets[pos] = kmerSets[i];
+	}
+}
+
+void ExactKmerIndex::renumberStrains(const std::vector<uint>& newIndices)
+{
+	std::vector<std::string> strainNames(m_strainNames.size());
+	for(uint i = 0; i < m_strainNames.size(); ++i)
+		strainNames[newIndices[i]] = m_strainNames[i];
+	m_strainNames.swap(strainNames);
+
+	for(ulong s = 0; s < m_setStrains.size(); ++s)
+		m_setStrains[s] = newIndices[m_setStrains[s]];
+}
+
+uint64 ExactKmerIndex::minimizerHash(uint64 kmer, uint64 reverseKmer) const
+{
+	// the l-mers of the reverse complement are the reverse complements of the l-mers of the k-mer, 
+	// so taking the smallest hash over both strands gives the same minimizer for either orientation
+	const uint64 lmerMask = (uint64(1) << (2*m_minimizerLength)) - 1;
+
+	uint64 minHash = ~uint64(0);
+	for(uint i = 0; i <= m_kmerLength - m_minimizerLength; ++i)
+	{
+		minHash = std::min(minHash, mixHash((kmer >> (2*i)) & lmerMask));
+		minHash = std::min(minHash, mixHash((reverseKmer >> (2*i)) & lmerMask));
+	}
+
+	return minHash;
+}
+
+uint ExactKmerIndex::lookup(uint64 canonicalKmer, uint64 bucketIndex) const
+{
+	const uint64* first = &m_kmers[0] + m_bucketOffsets[bucketIndex];
+	const uint64* last = &m_kmers[0] + m_bucketOffsets[bucketIndex + 1];
+
+	const uint64* kmer = std::lower_bound(first, last, canonicalKmer);
+	if(kmer == last || *kmer != canonicalKmer)
+		return NOT_FOUND;
+
+	return m_kmerSets[kmer - &m_kmers[0]];
+}
+
+ulong ExactKmerIndex::countHits(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, uint* hitCounts) const
+{
+	if(m_kmers.empty())
+		return 0;
+
+	// The minimizer is maintained over a window of the hashes of the l-mers of the current k-mer. When a k-mer 
+	// overlaps the previous k-mer by k-1 bases, only the hash of its last l-mer is new and the window is slid by 
+	// one l-mer. Each window entry is the smaller hash of an l-mer and its reverse complement. Overlapping 
+	// k-mers usually have the same strain set, so hits are added to strains once per run of k-mers with the same set.
+	struct HitVisitor
+	{
+		HitVisitor(const ExactKmerIndex& _index, uint* _hitCounts)
+			: index(_index), hitCounts(_hitCounts), numHits(0), bPrevKmer(false), prevKmer(0), head(0), minHash(0), 
+				runSetIndex(NOT_FOUND), runLength(0)
+		{
+			windowSize = index.m_kmerLength - index.m_minimizerLength + 1;
+			lmerMask = (uint64(1) << (2*index.m_minimizerLength)) - 1;
+			suffixMask = (uint64(1) << (2*(index.m_kmerLength - 1))) - 1;
+		}
+
+		void operator()(uint64 kmer)
+		{
+			uint64 reverseKmer = index.m_kmerCalculator->reverseComplement(kmer);
+
+			if(bPrevKmer && (kmer >> 2) == (prevKmer & suffixMask))
+			{
+				uint64 newHash = std::min(mixHash(kmer & lmerMask), mixHash(reverseKmer >> (2*(windowSize - 1))));
+				uint64 oldHash = window[head];
+				window[head] = newHash;
+				head = (head + 1 == windowSize) ? 0 : head + 1;
+
+				if(newHash <= minHash)
+					minHash = newHash;
+				else if(oldHash == minHash)
+					minHash = *std::min_element(window, window + windowSize);
+			}
+			else
+			{
+				for(uint i = 0; i < windowSize; ++i)
+					window[i] = std::min(mixHash((kmer >> (2*(windowSize - 1 - i))) & lmerMask), mixHash((reverseKmer >> (2*i)) & lmerMask));
+
+				head = 0;
+				minHash = *std::min_element(window, window + windowSize);
+			}
+
+			bPrevKmer = true;
+			prevKmer = kmer;
+
+			uint setIndex = index.lookup(std::min(kmer, reverseKmer), minHash & (index.m_numBuckets - 1));
+			if(setIndex == NOT_FOUND)
+				return;
+
+			if(setIndex != runSetIndex)
+			{
+				addRun();
+				runSetIndex = setIndex;
+			}
+			runLength++;
+
+			numHits++;
+		}
+
+		void addRun()
+		{
+			if(runLength == 0)
+				return;
+
+			for(uint s = index.m_setOffsets[runSetIndex]; s < index.m_setOffsets[runSetIndex + 1]; ++s)
+				hitCounts[index.m_setStrains[s]] += runLength;
+
+			runLength = 0;
+		}
+
+		const ExactKmerIndex& index;
+		uint* hitCounts;
+		ulong numHits;
+
+		uint windowSize;
+		uint64 lmerMask;
+		uint64 suffixMask;
+
+		bool bPrevKmer;
+		uint64 prevKmer;
+		uint64 window[KmerCalculator::MAX_KMER_LENGTH];
+		uint head;
+		uint64 minHash;
+
+		uint runSetIndex;
+		uint runLength;
+	};
+
+	HitVisitor visitor(*this, hitCounts);
+	m_kmerCalculator->visitForwardKmers(seqStore, seqOffset, seqLength, visitor);
+	visitor.addRun();
+
+	return visitor.numHits;
+}
+
+void ExactKmerIndex::write(const std::string& filename) const
+{
+	std::ofstream fout(filename.c_str(), std::ios::out | std::ios::binary);
+	if(!fout.is_open())
+	{
+		std::cout << "Failed to write exact k-mer index to file: " << filename << "." << std::endl;
+		return;
+	}
+
+	writeFileHeader(fout, "NBKX", FORMAT_VERSION);
+
+	fout.write((char*)&m_kmerLength, sizeof(uint));
+	fout.write((char*)&m_minimizerLength, sizeof(uint));
+
+	uint numStrains = m_strainNames.size();
+	fout.write((char*)&numStrains, sizeof(uint));
+	for(uint i = 0; i < numStrains; ++i)
+		writeName(fout, m_strainNames[i]);
+
+	uint64 numKmers = m_kmers.size();
+	uint64 numSetOffsets = m_setOffsets.size();
+	uint64 numSetStrains = m_setStrains.size();
+	fout.write((char*)&m_numBuckets, sizeof(uint64));
+	fout.write((char*)&numKmers, sizeof(uint64));
+	fout.write((char*)&numSetOffsets, sizeof(uint64));
+	fout.write((char*)&numSetStrains, sizeof(uint64));
+
+	fout.write((char*)&m_bucketOffsets[0], sizeof(uint64)*m_bucketOffsets.size());
+	if(numKmers > 0)
+	{
+		fout.write((char*)&m_kmers[0], sizeof(uint64)*numKmers);
+		fout.write((char*)&m_kmerSets[0], sizeof(uint)*numKmers);
+	}
+	fout.write((char*)&m_setOffsets[0], sizeof(uint)*numSetOffsets);
+	if(numSetStrains > 0)
+		fout.write((char*)&m_setStrains[0], sizeof(uint)*numSetStrains);
+
+	fout.close();
+}
+
+bool ExactKmerIndex::read(const std::string& filename)
+{
+	std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!fin.is_open())
+	{
+		std::cout << "Failed to read exact k-mer index from file: " << filename << "." << std::endl;
+		return false;
+	}
+
+	uint kmerLength, minimizerLength;
+	bool bValid = readFileHeader(fin, "NBKX", FORMAT_VERSION);
+	fin.read((char*)&kmerLength, sizeof(uint));
+	fin.read((char*)&minimizerLength, sizeof(uint));
+	if(!bValid || fin.fail() || kmerLength < 1 || kmerLength > KmerCalculator::MAX_KMER_LENGTH || minimizerLength < 1 || minimizerLength > kmerLength)
+	{
+		std::cout << "Invalid exact k-mer index: " << filename << "." << std::endl;
+		return false;
+	}
+	this->kmerLength(kmerLength);
+	m_minimizerLength = minimizerLength;
+
+	// sizes are checked against the remainder of the file before anything is allocated
+	uint numStrains;
+	fin.read((char*)&numStrains, sizeof(uint));
+	bValid = !fin.fail() && numStrains <= bytesRemaining(fin) / sizeof(size_t);
+	if(bValid)
+	{
+		m_strainNames.resize(numStrains);
+		for(uint i = 0; i < numStrains && bValid; ++i)
+			bValid = readName(fin, m_strainNames[i]);
+	}
+
+	uint64 numKmers, numSetOffsets, numSetStrains;
+	fin.read((char*)&m_numBuckets, sizeof(uint64));
+	fin.read((char*)&numKmers, sizeof(uint64));
+	fin.read((char*)&numSetOffsets, sizeof(uint64));
+	fin.read((char*)&numSetStrains, sizeof(uint64));
+
+	// buckets are found by masking hashes so their number must be a power of 2
+	bValid = bValid && !fin.fail() && m_numBuckets > 0 && (m_numBuckets & (m_numBuckets - 1)) == 0 && numSetOffsets > 0;
+	bValid = bValid && m_numBuckets < bytesRemaining(fin) / sizeof(uint64);
+
+	// each array is read with a single call
+	bValid = bValid && readArray(fin, m_bucketOffsets, m_numBuckets + 1);
+	bValid = bValid && readArray(fin, m_kmers, numKmers);
+	bValid = bValid && readArray(fin, m_kmerSets, numKmers);
+	bValid = bValid && readArray(fin, m_setOffsets, numSetOffsets);
+	bValid = bValid && readArray(fin, m_setStrains, numSetStrains);
+
+	// offsets and indices must stay within the arrays they refer to
+	for(uint64 i = 0; bValid && i < m_numBuckets; ++i)
+		bValid = m_bucketOffsets[i] <= m_bucketOffsets[i + 1];
+	bValid = bValid && m_bucketOffsets[0] == 0 && m_bucketOffsets[m_numBuckets] == numKmers;
+	for(uint64 i = 0; bValid && i < numKmers; ++i)
+		bValid = m_kmerSets[i] < numSetOffsets - 1;
+	for(uint64 i = 0; bValid && i + 1 < numSetOffsets; ++i)
+		bValid = m_setOffsets[i] <= m_setOffsets[i + 1];
+	bValid = bValid && m_setOffsets[0] == 0 && m_setOffsets[numSetOffsets - 1] == numSetStrains;
+	for(uint64 i = 0; bValid && i < numSetStrains; ++i)
+		bValid = m_setStrains[i] < numStrains;
+
+	if(!bValid)
+	{
+		std::cout << "Invalid exact k-mer index: " << filename << "." << std::endl;
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+ulong ExactKmerIndex::memoryUsage() const
+{
+	return m_bucketOffsets.capacity() * sizeof(uint64) + m_kmers.capacity() * sizeof(uint64) + m_kmerSets.capacity() * sizeof(uint)
+					+ m_setOffsets.capacity() * sizeof(uint) + m_setStrains.capacity() * sizeof(uint);
+}
\ No newline at end of file
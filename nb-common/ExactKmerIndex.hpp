@@ -0,0 +1,124 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef EXACT_KMER_INDEX
+#define EXACT_KMER_INDEX
+
+#include "stdafx.h"
+
+#include "KmerCalculator.hpp"
+
+// Index from long canonical k-mers (up to 31 bases) to the set of strains containing them, used to 
+// find the strains a fragment shares exact k-mers with. The canonical k-mer is the smaller of a k-mer 
+// and its reverse complement. K-mers are grouped into buckets by their minimizer, the shortest hash of 
+// the l-mers on either strand of the k-mer, so the overlapping k-mers of a fragment usually fall in the 
+// same bucket. Each bucket holds its k-mers in ascending order along with the index of their strain set, 
+// and each distinct strain set is stored once.
+class ExactKmerIndex
+{
+public:
+	static const uint DEFAULT_KMER_LENGTH = 31;
+	static const uint DEFAULT_MINIMIZER_LENGTH = 15;
+
+	// files start with the magic number "NBKX" and this version
+	static const uint FORMAT_VERSION = 1;
+
+public:
+	ExactKmerIndex();
+	~ExactKmerIndex();
+
+	void clear();
+
+	void kmerLength(uint kmerLength);
+	uint kmerLength() const { return m_kmerLength; }
+
+	// start adding sequences of a new strain, returning the index of the strain
+	uint addStrain(const std::string& name);
+
+	// add canonical k-mers of a sequence to the most recently added strain
+	void add(SeqInfo& seqInfo);
+
+	// arrange k-mers into buckets once all strains have been added
+	void build();
+
+	bool read(const std::string& filename);
+	void write(const std::string& filename) const;
+
+	// renumber strains so strain i becomes strain newIndices[i], such as to follow the order of a model file
+	void renumberStrains(const std::vector<uint>& newIndices);
+
+	uint numStrains() const { return m_strainNames.size(); }
+	const std::string& name(uint strainIndex) const { return m_strainNames[strainIndex]; }
+
+	ulong numKmers() const { return m_kmers.size(); }
+	uint numStrainSets() const { return m_setOffsets.size() - 1; }
+
+	// add the number of k-mers of a packed sequence found in each strain to hitCounts, returning the number of k-mers found
+	ulong countHits(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, uint* hitCounts) const;
+
+	ulong memoryUsage() const;
+
+private:
+	uint64 minimizerHash(uint64 kmer, uint64 reverseKmer) const;
+	uint64 bucket(uint64 kmer, uint64 reverseKmer) const { return minimizerHash(kmer, reverseKmer) & (m_numBuckets - 1); }
+
+	// strain set of a canonical k-mer, or NOT_FOUND
+	uint lookup(uint64 canonicalKmer, uint64 bucketIndex) const;
+
+	void flushStrain();
+
+private:
+	static const uint NOT_FOUND = 0xFFFFFFFF;
+
+	struct Entry
+	{
+		Entry() {}
+		Entry(uint64 _kmer, uint _strainIndex): kmer(_kmer), strainIndex(_strainIndex) {}
+
+		bool operator<(const Entry& other) const { return kmer < other.kmer || (kmer == other.kmer && strainIndex < other.strainIndex); }
+
+		uint64 kmer;
+		uint strainIndex;
+	};
+
+	uint m_kmerLength;
+	uint m_minimizerLength;
+	KmerCalculator* m_kmerCalculator;
+
+	std::vector<std::string> m_strainNames;
+
+	// canonical k-mers of the current strain and all previous strains prior to the index being built
+	std::vector<uint64> m_strainKmers;
+	std::vector<Entry> m_entries;
+	std::vector<uint64> m_kmerBuffer;
+
+	// k-mers of bucket i are in [m_bucketOffsets[i], m_bucketOffsets[i+1])
+	uint64 m_numBuckets;
+	std::vector<uint64> m_bucketOffsets;
+	std::vector<uint64> m_kmers;
+	std::vector<uint> m_kmerSets;
+
+	// strains of set i are in [m_setOffsets[i], m_setOffsets[i+1])
+	std::vector<uint> m_setOffsets;
+	std::vector<uint> m_setStrains;
+};
+
+#endif
\ No newline at end of file
@@ -23,16 +23,18 @@
 
 #include "FastaIO.hpp"
 
-FastaIO::FastaIO()
+FastaIO::FastaIO(ulong bufferSize)
 {
-	m_buffer = NULL;
+	m_blockSize = std::max(bufferSize / 2, ulong(1));
+	m_buffer = new char[2*m_blockSize];
 
 	initialize();
 }
 
-FastaIO::FastaIO(const std::string& filename) 
+FastaIO::FastaIO(const std::string& filename, ulong bufferSize) 
 { 
-	m_buffer = NULL;
+	m_blockSize = std::max(bufferSize / 2, ulong(1));
+	m_buffer = new char[2*m_blockSize];
 
 	initialize();
 
@@ -41,206 +43,314 @@ FastaIO::FastaIO(const std::string& filename)
 
 void FastaIO::initialize()
 {
+	m_inStream = &m_fileStream;
+
 	m_fileSize = 0;
 	m_bytesRead = 0;
 
-	m_bufferPos = 0;
-	m_bytesInBuffer = 0;
-}
+	m_block = m_buffer;
+	m_blockPos = 0;
+	m_bytesInBlock = 0;
 
-void FastaIO::setToFirstSeq() 
-{ 
-	m_bytesRead = 0;
-	m_bufferPos = 0;
-	m_bytesInBuffer = 0;
+	m_readAheadBlock = m_buffer + m_blockSize;
 
-	m_fileStream.clear();
+	m_bAtLineStart = true;
+
+	m_bError = false;
 }
 
 FastaIO::~FastaIO() 
 {
-	releaseMemory();
-	m_fileStream.close();
-}
+	close();
 
-void FastaIO::releaseMemory()
-{
-	if(m_buffer != NULL)
-		delete[] m_buffer;
-	
-	m_buffer = NULL;
+	delete[] m_buffer;
 }
 
 bool FastaIO::open(const std::string& filename)
 {
-	initialize();
+	close();
 
-	m_fileStream.open(filename.c_str(), std::ios::in | std::ios::binary);
-	if(!m_fileStream.is_open())
-		return false;
+	if(filename == "-")
+	{
+		// read sequences from standard input (size of input is unknown)
+		m_inStream = &std::cin;
 
-	// calculate size of file
-	m_fileStream.seekg(0, std::ios::end);
-	m_fileSize = (ulong)m_fileStream.tellg();
-	m_fileStream.seekg(0, std::ios::beg);
+		// stdin is read by the read-ahead thread so must not flush stdout
+		std::cin.tie(NULL);
+	}
+	else
+	{
+		m_fileStream.open(filename.c_str(), std::ios::in | std::ios::binary);
+		if(!m_fileStream.is_open())
+			return false;
 
-	// allocate memory for reading file
-	releaseMemory();
-	m_buffer = new char[BUFFER_SIZE];
+		// calculate size of file (not possible for pipes)
+		m_fileStream.seekg(0, std::ios::end);
+		std::streamoff fileSize = m_fileStream.tellg();
+		if(fileSize >= 0)
+		{
+			m_fileSize = (ulong)fileSize;
+			m_fileStream.seekg(0, std::ios::beg);
+		}
+		m_fileStream.clear();
+	}
+
+	startReadAhead();
 
 	return true;
 }
 
-bool FastaIO::nextSeq(SeqInfo& seqInfo, bool bKeepAlignment)
+void FastaIO::close()
 {
-	if (m_bytesRead - m_bytesInBuffer + m_bufferPos == m_fileSize)
-			return false;	// finished processing all sequences
+	// wait for outstanding read before releasing stream
+	if(m_readAhead.valid())
+		m_readAhead.wait();
+	m_readAhead = std::future<ulong>();
 
-	// determine if more sequences must be read from file
-	if(m_bufferPos == m_bytesInBuffer)
-	{
-		if(!fillBuffer())
-			return false;
-	}
+	if(m_fileStream.is_open())
+		m_fileStream.close();
+	m_fileStream.clear();
 
-	nextSeq(seqInfo, bKeepAlignment, m_buffer, m_bufferPos, m_bytesInBuffer);
-	
-	return true;	
+	initialize();
 }
 
-void FastaIO::nextSeq(SeqInfo& seqInfo, const bool bKeepAlignment, char* buffer, ulong& bufferPos, const ulong bytesInBuffer)
-{
-	// extract sequences id and null terminate
-	char* seqIdStart = (char *)(buffer + bufferPos + 1);
-	char* headerEnd = (char *)strchr(seqIdStart, '\n');
-	char* seqIdEnd = (char *)memchr(seqIdStart, ' ', headerEnd-seqIdStart);
-	
-	if(seqIdEnd != NULL)
-		seqIdEnd[0] = 0;	// null terminate at first space
-	
-	if(headerEnd == NULL)
-	{
-		// perhaps lines are terminated with just a carriage return (i.e., old mac style)
-		headerEnd = (char *)strchr(seqIdStart, '\r');
-	}
-
-	// check if line is terminated with a \r\n which is typical under Microsoft Windows
-	if(headerEnd[-1] == '\r')
-		headerEnd[-1] = 0;
-	else
-		headerEnd[0] = 0;
-		
-	seqInfo.seqId = seqIdStart;
+void FastaIO::setToFirstSeq() 
+{ 
+	if(m_readAhead.valid())
+		m_readAhead.wait();
+	m_readAhead = std::future<ulong>();
 
-	// extract sequence (removing any whitespace characters and optionally any alignment characters)
-	char *seqStart = headerEnd + 1;
+	m_bytesRead = 0;
+	m_blockPos = 0;
+	m_bytesInBlock = 0;
+	m_bAtLineStart = true;
+	m_bError = false;
 
-	char *seqEnd = seqStart;
-	bufferPos = (ulong) (seqStart - buffer);
-	while(bufferPos < bytesInBuffer)
-	{
-		char c = buffer[bufferPos];
-		if(c == '>')
-			break;
+	m_inStream->clear();
+	if(m_inStream == &m_fileStream)
+		m_fileStream.seekg(0, std::ios::beg);
 
-		++bufferPos;
-		if (isspace(c))
-			continue;
+	startReadAhead();
+}
 
-		if(!bKeepAlignment && (c == '-' || c == '.'))
-			continue;
+ulong FastaIO::readBlock(std::istream* inStream, char* block, ulong blockSize)
+{
+	inStream->read(block, blockSize);
 
-		*seqEnd++ = c;
-	}
+	return (ulong)inStream->gcount();
+}
 
-	seqInfo.seq = seqStart;
-	seqInfo.length = seqEnd - seqStart;
-	
-	// null terminate sequence data
-	seqEnd[0] = 0;	
+void FastaIO::startReadAhead()
+{
+	m_readAhead = std::async(std::launch::async, &FastaIO::readBlock, m_inStream, m_readAheadBlock, m_blockSize);
 }
 
-bool FastaIO::fillBuffer()
+bool FastaIO::nextBlock()
 {
-	m_bufferPos = 0;
+	m_blockPos = 0;
+	m_bytesInBlock = 0;
 
-	long bytesToRead = m_fileSize - m_bytesRead;
-	if (bytesToRead > BUFFER_SIZE)
-		bytesToRead = BUFFER_SIZE;
+	if(!m_readAhead.valid())
+		return false;	// no data remaining
 
-	m_fileStream.seekg(m_bytesRead, std::ios::beg);
-	if(m_fileStream.fail() || m_fileStream.bad())
+	// wait for read-ahead thread to finish filling block
+	ulong bytesRead = m_readAhead.get();
+	if(m_inStream->bad())
 	{
-		std::cerr << "Error reading FASTA file (seeking error)." << std::endl;
+		std::cerr << "Error reading FASTA file." << std::endl;
+		m_bError = true;
 		return false;
 	}
 
-	m_fileStream.read(m_buffer, bytesToRead);
-	if(m_fileStream.fail() || m_fileStream.bad())
+	std::swap(m_block, m_readAheadBlock);
+	m_bytesInBlock = bytesRead;
+	m_bytesRead += bytesRead;
+
+	// fill other block while this block is being parsed
+	if(!m_inStream->eof())
+		startReadAhead();
+
+	return m_bytesInBlock > 0;
+}
+
+bool FastaIO::nextSeq(SeqInfo& seqInfo, bool bKeepAlignment)
+{
+	// determine if more sequences must be read from file
+	if(m_blockPos == m_bytesInBlock && !nextBlock())
+		return false;	// finished processing all sequences
+
+	if(m_block[m_blockPos] != '>')
 	{
-		std::cerr << "Error reading FASTA file." << std::endl;
+		std::cerr << "Invalid FASTA file format." << std::endl;
+		m_bError = true;
 		return false;
 	}
-	else if(m_buffer[0] != '>')
+	++m_blockPos;
+
+	// extract sequences id (all text before first space on header line)
+	m_record.clear();
+
+	bool bInSeqId = true;
+	while(m_blockPos < m_bytesInBlock || nextBlock())
 	{
-		std::cerr << "Invalid FASTA file format." << std::endl;
-		return false;
+		char c = m_block[m_blockPos++];
+		if(c == '\n' || c == '\r')
+			break;
+
+		if(c == ' ')
+			bInSeqId = false;
+
+		if(bInSeqId)
+			m_record.push_back(c);
 	}
-	
-	m_bytesInBuffer = bytesToRead;
-	if(m_bytesRead + bytesToRead != m_fileSize)
+	m_record.push_back(0);
+
+	// extract sequence (removing any whitespace characters and optionally any alignment characters),
+	// sequences may span any number of blocks
+	ulong seqStart = m_record.size();
+
+	m_bAtLineStart = true;
+	bool bEndOfSeq = false;
+	while(!bEndOfSeq && (m_blockPos < m_bytesInBlock || nextBlock()))
 	{
-		// determine number of bytes until last complete sequence
-		int i = 0;
-		for(i = bytesToRead-1; i >= 0; i--)
+		// process remainder of current line in block
+		const char* lineStart = m_block + m_blockPos;
+		const char* blockEnd = m_block + m_bytesInBlock;
+		const char* lineEnd = (const char *)memchr(lineStart, '\n', blockEnd - lineStart);
+		lineEnd = (lineEnd == NULL) ? blockEnd : lineEnd + 1;
+
+		ulong seqLength = m_record.size();
+		m_record.resize(seqLength + (lineEnd - lineStart));
+		char* seqEnd = &m_record[seqLength];
+
+		const char* pos = lineStart;
+		for(; pos != lineEnd; ++pos)
 		{
-			if(m_buffer[i] == '>')
+			char c = *pos;
+			if(c == '>' && m_bAtLineStart)
+			{
+				bEndOfSeq = true;
 				break;
+			}
+
+			m_bAtLineStart = (c == '\n' || c == '\r');
+			if(isspace(c))
+				continue;
+
+			if(!bKeepAlignment && (c == '-' || c == '.'))
+				continue;
+
+			*seqEnd++ = c;
 		}
 
-		m_bytesInBuffer = i;
+		m_blockPos = pos - m_block;
+		m_record.resize(seqEnd - &m_record[0]);
 	}
 
-	m_bytesRead += m_bytesInBuffer;		
+	// null terminate sequence data
+	m_record.push_back(0);
 
-	return true;
+	seqInfo.seqId = &m_record[0];
+	seqInfo.seq = &m_record[seqStart];
+	seqInfo.length = m_record.size() - seqStart - 1;
+	
+	return true;	
 }
 
-float FastaIO::percentageProcessed() const
+uint FastaIO::nextSeqs(std::vector<SeqInfo>& seqInfo, uint maxSeqs, std::vector<char>& seqData, bool bKeepAlignment)
 {
-	return (m_bytesRead + m_bufferPos - m_bytesInBuffer) * 100.0f / m_fileSize;
+	seqInfo.clear();
+	seqData.clear();
+
+	// copy sequences into caller's storage since the record buffer is reused for each sequence
+	std::vector<ulong> idOffsets;
+	SeqInfo info;
+	while(seqInfo.size() < maxSeqs && nextSeq(info, bKeepAlignment))
+	{
+		idOffsets.push_back(seqData.size());
+		seqData.insert(seqData.end(), info.seqId, info.seqId + strlen(info.seqId) + 1);
+		seqData.insert(seqData.end(), info.seq, info.seq + info.length + 1);
+
+		seqInfo.push_back(info);
+	}
+
+	// point to sequence data once storage is no longer being resized
+	for(uint i = 0; i < seqInfo.size(); ++i)
+	{
+		seqInfo[i].seqId = &seqData[idOffsets[i]];
+		seqInfo[i].seq = seqInfo[i].seqId + strlen(seqInfo[i].seqId) + 1;
+	}
+
+	return seqInfo.size();
 }
 
-bool FastaIO::readSeqs(const std::string& filename, std::vector<SeqInfo>& seqInfo, char* buffer, uint verbose, bool bKeepAlignment)
+uint FastaIO::nextSeqs(FragmentTable& fragments, uint maxSeqs)
 {
-	m_fileStream.open(filename.c_str(), std::ios::in | std::ios::binary);
-	if(!m_fileStream.is_open())
-		return false;
+	fragments.clear();
 
-	// calculate size of file
-	m_fileStream.seekg(0, std::ios::end);
-	m_fileSize = m_fileStream.tellg();
-	m_fileStream.seekg(0, std::ios::beg);
+	SeqInfo info;
+	while(fragments.size() < maxSeqs && nextSeq(info))
+		fragments.add(info.seqId, info.seq, info.length);
 
-	// allocate memory for reading file
-	buffer = new char[m_fileSize];
+	return fragments.size();
+}
 
-	// read file into buffer
-	m_fileStream.read(buffer, m_fileSize);
-	if(m_fileStream.fail() || m_fileStream.bad())
-		return false;
+// length of sequence id without a trailing /1 or /2 mate suffix
+static ulong mateIdLength(const char* seqId)
+{
+	ulong length = strlen(seqId);
+	if(length >= 2 && seqId[length-2] == '/' && (seqId[length-1] == '1' || seqId[length-1] == '2'))
+		return length - 2;
+
+	return length;
+}
+
+bool FastaIO::nextPairs(FragmentTable& fragments, uint maxPairs, FastaIO& mateIO)
+{
+	fragments.clear();
 
-	// determine position of each sequence in buffer
-	ulong bufferPos = 0;
-	while(bufferPos != m_fileSize)
+	// first mate is copied since reading the second mate from the same file reuses the record buffer
+	std::vector<char> firstMate;
+	SeqInfo info;
+	while(fragments.size() < maxPairs && nextSeq(info))
 	{
-		SeqInfo info;
-		nextSeq(info, bKeepAlignment, buffer, bufferPos, m_fileSize);
-		seqInfo.push_back(info);
+		firstMate.assign(info.seqId, info.seq + info.length + 1);
+		const char* firstId = &firstMate[0];
+		const char* firstSeq = &firstMate[info.seq - info.seqId];
+		ulong firstLength = info.length;
+
+		SeqInfo mateInfo;
+		if(!mateIO.nextSeq(mateInfo))
+		{
+			std::cerr << "No mate for sequence: " << firstId << std::endl;
+			return false;
+		}
+
+		ulong idLength = mateIdLength(firstId);
+		if(mateIdLength(mateInfo.seqId) != idLength || strncmp(firstId, mateInfo.seqId, idLength) != 0)
+		{
+			std::cerr << "Mates are not paired: " << firstId << " and " << mateInfo.seqId << std::endl;
+			return false;
+		}
+
+		firstMate[idLength] = 0;
+		fragments.addPair(firstId, firstSeq, firstLength, mateInfo.seq, mateInfo.length);
+	}
 
-		if(verbose >= 3)
-			std::cout << "Read fragment: " << info.seqId << std::endl;
+	// all mates in a separate mate file must be paired
+	if(fragments.size() < maxPairs && &mateIO != this && mateIO.nextSeq(info))
+	{
+		std::cerr << "No mate for sequence: " << info.seqId << std::endl;
+		return false;
 	}
 
 	return true;
+}
+
+float FastaIO::percentageProcessed() const
+{
+	if(m_fileSize == 0)
+		return 0.0f;	// size of input stream is unknown
+
+	return (m_bytesRead - m_bytesInBlock + m_blockPos) * 100.0f / m_fileSize;
 }
\ No newline at end of file
@@ -24,45 +24,73 @@
 
 #include "stdafx.h"
 
+#include "FragmentTable.hpp"
+
 class FastaIO 
 {
 public:
-	static const long BUFFER_SIZE = 500 * 1024 * 1024;	// 500 Mbyte buffer
+	static const ulong DEFAULT_BUFFER_SIZE = 8 * 1024 * 1024;	// 8 Mbyte buffer (two 4 Mbyte blocks)
 
 public:
-	FastaIO();
-	FastaIO(const std::string& filename);
+	FastaIO(ulong bufferSize = DEFAULT_BUFFER_SIZE);
+	FastaIO(const std::string& filename, ulong bufferSize = DEFAULT_BUFFER_SIZE);
 
 	~FastaIO();
 
 	bool open(const std::string& filename);
+	void close();
 
+	// sequence data is only valid until the next call to nextSeq()
 	bool nextSeq(SeqInfo& seqInfo, bool bKeepAlignment = true);
 
+	uint nextSeqs(std::vector<SeqInfo>& seqInfo, uint maxSeqs, std::vector<char>& seqData, bool bKeepAlignment = true);
+	uint nextSeqs(FragmentTable& fragments, uint maxSeqs);
+
+	// Read pairs of mates, with the first mate of each pair read from this file and the second mate from 
+	// the mate file, which is this file when mates are interleaved. Each pair is added as a single fragment 
+	// named after the first mate without a /1 suffix. Returns false if the mates are not paired.
+	bool nextPairs(FragmentTable& fragments, uint maxPairs, FastaIO& mateIO);
+
+	// true if the last sequence could not be read because the file is malformed or could not be read,
+	// rather than because all sequences have been read
+	bool error() const { return m_bError; }
+
 	float percentageProcessed() const;
 
 	void setToFirstSeq();
 
-	bool readSeqs(const std::string& filename, std::vector<SeqInfo>& seqInfo, char* buffer, uint verbose = 0, bool bKeepAlignment = true);
-
 private:
-	void nextSeq(SeqInfo& seqInfo, const bool bKeepAlignment, char* buffer, ulong& bufferPos, const ulong bytesInBuffer);
+	bool nextBlock();
+	void startReadAhead();
 
-	bool fillBuffer();
+	static ulong readBlock(std::istream* inStream, char* block, ulong blockSize);
 
 	void initialize();
-	void releaseMemory();
 
 private:
-
 	std::ifstream m_fileStream;
+	std::istream* m_inStream;
 
 	ulong m_fileSize;
 	ulong m_bytesRead;
 
+	// double buffer: one block is parsed while the other is filled by a read-ahead thread
 	char* m_buffer;
-	ulong m_bufferPos;
-	ulong m_bytesInBuffer;
+	ulong m_blockSize;
+
+	char* m_block;
+	ulong m_blockPos;
+	ulong m_bytesInBlock;
+
+	char* m_readAheadBlock;
+	std::future<ulong> m_readAhead;
+
+	bool m_bAtLineStart;
+
+	bool m_bError;
+
+	// sequence id and data of current sequence
+	std::vector<char> m_record;
 };
 
 #endif
\ No newline at end of file
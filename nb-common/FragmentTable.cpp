@@ -0,0 +1,76 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "FragmentTable.hpp"
+
+FragmentTable::FragmentTable()
+{
+	clear();
+}
+
+void FragmentTable::clear()
+{
+	// memory is retained so the table can be reused for each batch of fragments
+	m_seqIds.clear();
+	m_seqIdOffset.clear();
+
+	m_seqStart.clear();
+	m_seqStart.push_back(0);
+	m_validKmers.clear();
+
+	m_seqStore.clear();
+}
+
+uint FragmentTable::add(const char* seqId, const char* seq, ulong length)
+{
+	m_seqIdOffset.push_back(m_seqIds.size());
+	m_seqIds.insert(m_seqIds.end(), seqId, seqId + strlen(seqId) + 1);
+
+	m_seqStore.add(seq, length);
+	m_seqStart.push_back(m_seqStore.size());
+
+	m_validKmers.push_back(0);
+
+	return size() - 1;
+}
+
+uint FragmentTable::addPair(const char* seqId, const char* seq1, ulong length1, const char* seq2, ulong length2)
+{
+	m_seqIdOffset.push_back(m_seqIds.size());
+	m_seqIds.insert(m_seqIds.end(), seqId, seqId + strlen(seqId) + 1);
+
+	m_seqStore.add(seq1, length1);
+	m_seqStore.add("N", 1);
+	m_seqStore.add(seq2, length2);
+	m_seqStart.push_back(m_seqStore.size());
+
+	m_validKmers.push_back(0);
+
+	return size() - 1;
+}
+
+ulong FragmentTable::memoryUsage() const
+{
+	return m_seqIds.size() + m_seqIdOffset.size()*sizeof(uint) + m_seqStart.size()*sizeof(uint64)
+				+ m_validKmers.size()*sizeof(uint) + m_seqStore.memoryUsage();
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef FRAGMENT_TABLE
+#define FRAGMENT_TABLE
+
+#include "stdafx.h"
+
+#include "PackedSeqStore.hpp"
+
+// Lightweight table of query fragments stored as parallel arrays. Fragment ids are 
+// stored once in a shared string arena and sequence data is held by a packed store,
+// so each fragment requires only 16 bytes of metadata.
+class FragmentTable
+{
+public:
+	FragmentTable();
+
+	void clear();
+
+	uint add(const char* seqId, const char* seq, ulong length);
+
+	// Paired mates are stored as a single fragment with the mates separated by an ambiguous base, so 
+	// no k-mer spans both mates and the log likelihood of the fragment is the sum over both mates.
+	// The length of a pair includes the separator.
+	uint addPair(const char* seqId, const char* seq1, ulong length1, const char* seq2, ulong length2);
+
+	uint size() const { return m_validKmers.size(); }
+
+	const char* seqId(uint index) const { return &m_seqIds[m_seqIdOffset[index]]; }
+
+	ulong seqOffset(uint index) const { return m_seqStart[index]; }
+	ulong length(uint index) const { return m_seqStart[index+1] - m_seqStart[index]; }
+
+	void validKmers(uint index, ulong validKmers) { m_validKmers[index] = validKmers; }
+	ulong validKmers(uint index) const { return m_validKmers[index]; }
+
+	const PackedSeqStore& seqStore() const { return m_seqStore; }
+
+	ulong memoryUsage() const;
+
+private:
+	std::vector<char> m_seqIds;
+	std::vector<uint> m_seqIdOffset;
+
+	std::vector<uint64> m_seqStart;
+	std::vector<uint> m_validKmers;
+
+	PackedSeqStore m_seqStore;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "FragmentWindows.hpp"
+#include "Utils.hpp"
+
+FragmentWindows::FragmentWindows()
+{
+	clear();
+}
+
+void FragmentWindows::clear()
+{
+	m_firstWindow.clear();
+	m_firstWindow.push_back(0);
+
+	m_fragment.clear();
+	m_start.clear();
+	m_length.clear();
+	m_firstKmer.clear();
+	m_validKmers.clear();
+}
+
+void FragmentWindows::build(const FragmentTable& fragments, uint kmerLength, ulong windowLength, ulong step)
+{
+	clear();
+
+	const PackedSeqStore& seqStore = fragments.seqStore();
+	std::vector<ulong> validBefore;
+	for(uint fragment = 0; fragment < fragments.size(); ++fragment)
+	{
+		ulong offset = fragments.seqOffset(fragment);
+		ulong length = fragments.length(fragment);
+
+		// number of valid k-mers starting before each position, where k-mers overlapping an ambiguous base are invalid
+		ulong numStarts = (length < kmerLength) ? 0 : length - kmerLength + 1;
+		validBefore.assign(numStarts + 1, 1);
+		validBefore[0] = 0;
+		for(uint run = seqStore.firstAmbiguousRun(offset); run < seqStore.numAmbiguousRuns() && seqStore.ambiguousRunStart(run) < offset + length; ++run)
+		{
+			ulong runStart = std::max(seqStore.ambiguousRunStart(run), offset) - offset;
+			ulong runEnd = std::min(seqStore.ambiguousRunEnd(run), offset + length) - offset;
+			for(ulong pos = (runStart + 1 > kmerLength) ? runStart + 1 - kmerLength : 0; pos < std::min(runEnd, numStarts); ++pos)
+				validBefore[pos + 1] = 0;
+		}
+
+		for(ulong pos = 1; pos <= numStarts; ++pos)
+			validBefore[pos] += validBefore[pos - 1];
+
+		// window starts, with a final window ending at the end of the fragment
+		std::vector<ulong> starts;
+		if(length <= windowLength)
+			starts.push_back(0);
+		else
+		{
+			for(ulong start = 0; start + windowLength <= length; start += step)
+				starts.push_back(start);
+
+			if(starts.back() + windowLength < length)
+				starts.push_back(length - windowLength);
+		}
+
+		for(uint i = 0; i < starts.size(); ++i)
+		{
+			ulong windowEnd = std::min(starts[i] + windowLength, length);
+			ulong firstStart = std::min(starts[i], numStarts);
+			ulong endStart = (windowEnd < kmerLength) ? firstStart : std::max(std::min(windowEnd - kmerLength + 1, numStarts), firstStart);
+
+			m_fragment.push_back(fragment);
+			m_start.push_back(starts[i]);
+			m_length.push_back(windowEnd - starts[i]);
+			m_firstKmer.push_back(validBefore[firstStart]);
+			m_validKmers.push_back(validBefore[endStart] - validBefore[firstStart]);
+		}
+
+		m_firstWindow.push_back(m_fragment.size());
+	}
+}
+
+std::string FragmentWindows::id(const FragmentTable& fragments, uint window) const
+{
+	return std::string(fragments.seqId(m_fragment[window])) + ":" + numberToStr((uint)(m_start[window] + 1)) + "-" + numberToStr((uint)(m_start[window] + m_length[window]));
+}
+
+ulong FragmentWindows::memoryUsage() const
+{
+	return (m_firstWindow.size() + m_fragment.size())*sizeof(uint) 
+				+ (m_start.size() + m_length.size() + m_firstKmer.size() + m_validKmers.size())*sizeof(ulong);
+}
\ No newline at end of file
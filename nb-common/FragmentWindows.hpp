@@ -0,0 +1,73 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef FRAGMENT_WINDOWS
+#define FRAGMENT_WINDOWS
+
+#include "stdafx.h"
+
+#include "FragmentTable.hpp"
+
+// Windows of the fragments in a batch that are classified separately, such as to locate chimeric 
+// or horizontally transferred regions of long reads and contigs. Each window is described by the 
+// range of valid k-mers of its fragment that lie entirely within the window, so the log likelihood 
+// of every window follows from prefix sums over the k-mers of the fragment.
+class FragmentWindows
+{
+public:
+	FragmentWindows();
+
+	void clear();
+
+	// windows of the given length starting every step bases, with a final window ending at the end of
+	// each fragment, where fragments no longer than the window length form a single window
+	void build(const FragmentTable& fragments, uint kmerLength, ulong windowLength, ulong step);
+
+	uint size() const { return m_fragment.size(); }
+
+	// windows of a fragment are [firstWindow(fragment), firstWindow(fragment + 1))
+	uint firstWindow(uint fragment) const { return m_firstWindow[fragment]; }
+	uint fragment(uint window) const { return m_fragment[window]; }
+
+	// position of window within its fragment
+	ulong start(uint window) const { return m_start[window]; }
+	ulong length(uint window) const { return m_length[window]; }
+
+	// valid k-mers of the window as a range of the valid k-mers of its fragment
+	ulong firstKmer(uint window) const { return m_firstKmer[window]; }
+	ulong validKmers(uint window) const { return m_validKmers[window]; }
+
+	// fragment id followed by the 1-based inclusive range of the window (e.g., contig1:1001-6000)
+	std::string id(const FragmentTable& fragments, uint window) const;
+
+	ulong memoryUsage() const;
+
+private:
+	std::vector<uint> m_firstWindow;
+
+	std::vector<uint> m_fragment;
+	std::vector<ulong> m_start;
+	std::vector<ulong> m_length;
+	std::vector<ulong> m_firstKmer;
+	std::vector<ulong> m_validKmers;
+};
+
+#endif
\ No newline at end of file
@@ -34,11 +34,9 @@ KmerCalculator::KmerCalculator(uint wordLength): m_wordLength(wordLength)
 	{
 		m_bitShift = 2;
 
-		m_numPossibleWords = 1 << (2*m_wordLength);
+		m_numPossibleWords = (uint64)1 << (2*m_wordLength);
 
-		m_topMultiplier = 1 << (2 * (m_wordLength-1));		// equivalent to pow(4, m_wordLength-1)
-
-		m_kmerWordCount = new uint[m_numPossibleWords];
+		m_topMultiplier = (uint64)1 << (2 * (m_wordLength-1));		// equivalent to pow(4, m_wordLength-1)
 
 		// map nucleotides to values
 		m_ntValues = new byte[256];
@@ -63,11 +61,9 @@ KmerCalculator::KmerCalculator(uint wordLength): m_wordLength(wordLength)
 	{
 		m_bitShift = 1;
 
-		m_numPossibleWords = 1 << (m_wordLength);
-
-		m_topMultiplier = 1 << (m_wordLength-1);		// equivalent to pow(2, m_wordLength-1)
+		m_numPossibleWords = (uint64)1 << (m_wordLength);
 
-		m_kmerWordCount = new uint[m_numPossibleWords];
+		m_topMultiplier = (uint64)1 << (m_wordLength-1);		// equivalent to pow(2, m_wordLength-1)
 
 		// map nucleotides to values
 		m_ntValues = new byte[256];
@@ -88,11 +84,37 @@ KmerCalculator::KmerCalculator(uint wordLength): m_wordLength(wordLength)
 		m_ntReverseValues['t'] = m_ntReverseValues['T'] = 1;
 		m_ntReverseValues['u'] = m_ntReverseValues['U'] = 1;
 	}
+
+	// map 2-bit packed bases to values
+	m_packedValues[0] = m_ntValues['A'];
+	m_packedValues[1] = m_ntValues['C'];
+	m_packedValues[2] = m_ntValues['G'];
+	m_packedValues[3] = m_ntValues['T'];
+
+	// canonical k-mers are decided by the middle base for odd k and the middle base pair for even k
+	m_canonicalSymbolBits = (m_wordLength % 2 == 1) ? 2 : 4;
+	m_canonicalShift = (m_wordLength % 2 == 1) ? m_wordLength - 1 : m_wordLength - 2;
+	
+	// assign consecutive codes to symbols no larger than their reverse complement
+	m_canonicalRadix = 0;
+	memset(m_canonicalCode, 0, sizeof(m_canonicalCode));
+	for(uint symbol = 0; symbol < (1U << m_canonicalSymbolBits); ++symbol)
+	{
+		uint reverseSymbol;
+		if(m_canonicalSymbolBits == 2)
+			reverseSymbol = symbol ^ 3;
+		else
+			reverseSymbol = (((symbol & 3) ^ 3) << 2) | ((symbol >> 2) ^ 3);
+
+		if(symbol <= reverseSymbol)
+			m_canonicalCode[symbol] = m_canonicalRadix++;
+	}
+
+	m_numCanonicalWords = m_canonicalRadix * (m_numPossibleWords >> m_canonicalSymbolBits);
 }
 
 KmerCalculator::~KmerCalculator()
 {
-	delete[] m_kmerWordCount;
 	delete[] m_ntValues;
 }
 
@@ -126,19 +148,17 @@ void KmerCalculator::extractForwardKmers(SeqInfo& seqInfo, std::vector<uint>& km
 		seqInfo.validKmers += 1;
 	}
 
-	// calculate new kmer number for each 1 nt shift of the window
+	// calculate new kmer number for each 1 nt shift of the window, masking off the nt leaving the window
+	const ulong wordMask = m_numPossibleWords - 1;
 	for(ulong i = m_wordLength; i < seqInfo.length; ++i)
 	{
-		// subtract value for nt leaving window
-		word -= m_topMultiplier * m_ntValues[(byte)seq[i - m_wordLength]];
-
 		// add value of nt entering window
 		byte value = m_ntValues[(byte)seq[i]];
 
 		if(value == INVALID_NT_CHARACTER)
 			indexOfInvalidCharacter = m_wordLength;
 
-		word = (word << m_bitShift) + value;
+		word = ((word << m_bitShift) + value) & wordMask;
 
 		indexOfInvalidCharacter = max(-1, indexOfInvalidCharacter - 1);
 
@@ -151,66 +171,172 @@ void KmerCalculator::extractForwardKmers(SeqInfo& seqInfo, std::vector<uint>& km
 	}
 }
 
+// Writes each k-mer to consecutive elements of a caller-provided array
+struct KmerWriter
+{
+	KmerWriter(uint* _kmerValues): kmerValues(_kmerValues) {}
+
+	void operator()(uint kmer) { *kmerValues++ = kmer; }
+
+	uint* kmerValues;
+};
+
+ulong KmerCalculator::extractForwardKmers(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, uint* kmerValues)
+{
+	KmerWriter writer(kmerValues);
+	return visitForwardKmers(seqStore, seqOffset, seqLength, writer);
+}
+
+void KmerCalculator::canonicalIndices(uint* kmerValues, ulong numKmers) const
+{
+	for(ulong i = 0; i < numKmers; ++i)
+		kmerValues[i] = canonicalIndex(kmerValues[i]);
+}
+
+ulong KmerCalculator::compactKmers(uint* kmerValues, ulong numKmers, uint* kmerCounts)
+{
+	if(numKmers == 0)
+		return 0;
+
+	// short profiles are sorted directly while long profiles use an LSD radix sort on 8-bit digits
+	const ulong RADIX_SORT_THRESHOLD = 256;
+	if(numKmers < RADIX_SORT_THRESHOLD)
+	{
+		std::sort(kmerValues, kmerValues + numKmers);
+	}
+	else
+	{
+		if(m_sortBuffer.size() < numKmers)
+			m_sortBuffer.resize(numKmers);
+
+		uint* src = kmerValues;
+		uint* dest = &m_sortBuffer[0];
+
+		uint numPasses = (2*m_wordLength + 7) / 8;
+		for(uint pass = 0; pass < numPasses; ++pass)
+		{
+			uint shift = 8*pass;
+
+			ulong offsets[256] = {0};
+			for(ulong i = 0; i < numKmers; ++i)
+				offsets[(src[i] >> shift) & 0xFF]++;
+
+			ulong total = 0;
+			for(uint d = 0; d < 256; ++d)
+			{
+				ulong count = offsets[d];
+				offsets[d] = total;
+				total += count;
+			}
+
+			for(ulong i = 0; i < numKmers; ++i)
+				dest[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+
+			std::swap(src, dest);
+		}
+
+		if(src != kmerValues)
+			memcpy(kmerValues, src, numKmers*sizeof(uint));
+	}
+
+	// collapse runs of identical k-mers
+	ulong numDistinct = 0;
+	for(ulong i = 0; i < numKmers; ++i)
+	{
+		if(numDistinct > 0 && kmerValues[i] == kmerValues[numDistinct-1])
+		{
+			kmerCounts[numDistinct-1]++;
+		}
+		else
+		{
+			kmerValues[numDistinct] = kmerValues[i];
+			kmerCounts[numDistinct] = 1;
+			numDistinct++;
+		}
+	}
+
+	return numDistinct;
+}
+
 void KmerCalculator::extractKmers(SeqInfo& seqInfo, std::vector<uint>& kmerValues)
 {	
-	kmerValues.reserve(2 * (seqInfo.length - m_wordLength + 1));
+	seqInfo.validKmers = 0;
+	if(seqInfo.length < m_wordLength)
+		return;
 
-	// calculate kmer number for initial window
+	kmerValues.reserve(kmerValues.size() + 2 * (seqInfo.length - m_wordLength + 1));
+
+	// roll forward and reverse complement words one nt at a time, recording words not containing an invalid nt
 	const char* seq = seqInfo.seq;
+	const ulong wordMask = m_numPossibleWords - 1;
+	const ulong valueMask = ((ulong)1 << m_bitShift) - 1;
+	const uint topShift = m_bitShift * (m_wordLength - 1);
+
 	ulong word = 0;
 	ulong reverseWord = 0;
 	int indexOfInvalidCharacter = -1;
-	seqInfo.validKmers = 0;
-	for(ulong i = 0; i < m_wordLength; ++i)
+	for(ulong i = 0; i < seqInfo.length; ++i)
 	{
 		byte value = m_ntValues[(byte)seq[i]];
-		byte reverseValue = m_ntReverseValues[(byte)seq[m_wordLength-i-1]];
+		byte reverseValue = m_ntReverseValues[(byte)seq[i]];
 
 		if(value == INVALID_NT_CHARACTER)
 			indexOfInvalidCharacter = m_wordLength;
 
-		word = (word << m_bitShift) + value;
-		reverseWord = (reverseWord << m_bitShift) + reverseValue;
+		word = ((word << m_bitShift) | (value & valueMask)) & wordMask;
+		reverseWord = (reverseWord >> m_bitShift) | ((reverseValue & valueMask) << topShift);
 
 		indexOfInvalidCharacter = max(-1, indexOfInvalidCharacter - 1);
-	}
 
-	// record word
-	if(indexOfInvalidCharacter == -1)
-	{
-		kmerValues.push_back(word);
-		kmerValues.push_back(reverseWord);
+		// record word
+		if(i + 1 >= m_wordLength && indexOfInvalidCharacter == -1)
+		{
+			kmerValues.push_back(word);
+			kmerValues.push_back(reverseWord);
 
-		seqInfo.validKmers += 2;
+			seqInfo.validKmers += 2;
+		}
 	}
+}
 
-	// calculate new kmer number for each 1 nt shift of the window
-	for(ulong i = m_wordLength; i < seqInfo.length; ++i)
+void KmerCalculator::extractKmers(SeqInfo& seqInfo, std::vector<uint64>& kmerValues)
+{
+	seqInfo.validKmers = 0;
+	if(seqInfo.length < m_wordLength)
+		return;
+
+	kmerValues.reserve(kmerValues.size() + 2 * (seqInfo.length - m_wordLength + 1));
+
+	// roll forward and reverse complement words one nt at a time, recording words not containing an invalid nt
+	const char* seq = seqInfo.seq;
+	const uint64 wordMask = m_numPossibleWords - 1;
+	const uint64 valueMask = ((uint64)1 << m_bitShift) - 1;
+	const uint topShift = m_bitShift * (m_wordLength - 1);
+
+	uint64 word = 0;
+	uint64 reverseWord = 0;
+	int indexOfInvalidCharacter = -1;
+	for(ulong i = 0; i < seqInfo.length; ++i)
 	{
-		// subtract value for nt leaving window
-		word -= m_topMultiplier * m_ntValues[(byte)seq[i - m_wordLength]];
-		reverseWord -= m_ntReverseValues[(byte)seq[i - m_wordLength]];
-		
-		// add value of nt entering window
 		byte value = m_ntValues[(byte)seq[i]];
 		byte reverseValue = m_ntReverseValues[(byte)seq[i]];
 
 		if(value == INVALID_NT_CHARACTER)
 			indexOfInvalidCharacter = m_wordLength;
 
-		word = (word << m_bitShift) + value;
-		reverseWord = (reverseWord >> m_bitShift) + m_topMultiplier * reverseValue;
+		word = ((word << m_bitShift) | (value & valueMask)) & wordMask;
+		reverseWord = (reverseWord >> m_bitShift) | ((reverseValue & valueMask) << topShift);
 
 		indexOfInvalidCharacter = max(-1, indexOfInvalidCharacter - 1);
 
 		// record word
-		if(indexOfInvalidCharacter == -1)
+		if(i + 1 >= m_wordLength && indexOfInvalidCharacter == -1)
 		{
 			kmerValues.push_back(word);
 			kmerValues.push_back(reverseWord);
 
 			seqInfo.validKmers += 2;
-		}		
+		}
 	}
 }
 
@@ -243,3 +369,33 @@ void KmerCalculator::baseFrequencies(SeqInfo& seqInfo, std::vector<float>& baseF
 	baseFrequencies[3] += atCount;
 }
 
+void KmerCalculator::gcWindowCounts(const SeqInfo& seqInfo, uint windowLength, std::vector<uint64>& windowCounts) const
+{
+	if(windowCounts.size() < windowLength + 1)
+		windowCounts.resize(windowLength + 1, 0);
+
+	// slide window along sequence keeping counts of G/C and ambiguous bases within the window
+	uint gcBases = 0;
+	uint ambiguousBases = 0;
+	for(ulong i = 0; i < seqInfo.length; ++i)
+	{
+		char base = toupper(seqInfo.seq[i]);
+		if(base == 'C' || base == 'G')
+			gcBases++;
+		else if(base != 'A' && base != 'T')
+			ambiguousBases++;
+
+		if(i >= windowLength)
+		{
+			char firstBase = toupper(seqInfo.seq[i - windowLength]);
+			if(firstBase == 'C' || firstBase == 'G')
+				gcBases--;
+			else if(firstBase != 'A' && firstBase != 'T')
+				ambiguousBases--;
+		}
+
+		if(i + 1 >= windowLength && ambiguousBases == 0)
+			windowCounts[gcBases]++;
+	}
+}
+
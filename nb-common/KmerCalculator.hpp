@@ -24,36 +24,242 @@
 
 #include "stdafx.h"
 
+#include "PackedSeqStore.hpp"
+
 class KmerCalculator
 {
 public:
 	static const byte INVALID_NT_CHARACTER = 255;
 
+	// longest k-mer that fits in a 64-bit word
+	static const uint MAX_KMER_LENGTH = 31;
+
 public:
 	KmerCalculator(uint wordLength);
 	~KmerCalculator();
 
-	ulong numPossibleWords() const { return m_numPossibleWords; }
-	ulong topMultiplier() const { return m_topMultiplier; }
+	uint64 numPossibleWords() const { return m_numPossibleWords; }
+	uint64 topMultiplier() const { return m_topMultiplier; }
 
 	byte ntValue(byte c) const { return m_ntValues[c]; }
 
 	void extractKmers(SeqInfo& seqInfo, std::vector<uint>& kmerValues);
+
+	// k-mers on both strands as 64-bit values, supporting k-mer lengths up to MAX_KMER_LENGTH
+	void extractKmers(SeqInfo& seqInfo, std::vector<uint64>& kmerValues);
 	void extractForwardKmers(SeqInfo& seqInfo, std::vector<uint>& kmerValues);
 
+	// maximum number of k-mers in a sequence of the given length
+	ulong maxKmers(ulong seqLength) const { return seqLength < m_wordLength ? 0 : seqLength - m_wordLength + 1; }
+
+	// write the valid forward k-mers of a packed sequence to an array with room for maxKmers(seqLength) k-mers
+	ulong extractForwardKmers(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, uint* kmerValues);
+
+	// pass each valid forward k-mer of a packed sequence to visitor(kmer) as it is formed, where 
+	// kmer is a 64-bit value that is narrowed by visitors of models with k-mers of at most 16 bases
+	template<class KmerVisitor>
+	ulong visitForwardKmers(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, KmerVisitor& visitor) const;
+
+	// smallest and largest k-mer lengths with an extraction loop specialized at compile time
+	static const uint MIN_SPECIALIZED_KMER_LENGTH = 4;
+	static const uint MAX_SPECIALIZED_KMER_LENGTH = 16;
+
+	// Canonical k-mers identify a k-mer with its reverse complement. The orientation whose middle base 
+	// (odd k) or middle base pair (even k) has the smaller value is used, and ties are broken by the 
+	// smaller k-mer. Canonical k-mers are given indices in a table of numCanonicalWords() entries, which 
+	// is 1/2 of all k-mers for odd k and 5/8 of all k-mers for even k.
+	bool supportsCanonical() const { return m_bitShift == 2; }
+	ulong numCanonicalWords() const { return m_numCanonicalWords; }
+
+	uint64 reverseComplement(uint64 kmer) const;
+	uint canonicalIndex(uint kmer) const;
+	void canonicalIndices(uint* kmerValues, ulong numKmers) const;
+
+	// sort k-mers into ascending order and collapse repeated k-mers into (k-mer, count) pairs,
+	// returning the number of distinct k-mers
+	ulong compactKmers(uint* kmerValues, ulong numKmers, uint* kmerCounts);
+
 	void baseFrequencies(SeqInfo& seqInfo, std::vector<float>& baseFrequencies, ulong& numValidBases);
 
+	// add number of windows of the given length with each possible number of G or C bases, skipping windows with ambiguous bases
+	void gcWindowCounts(const SeqInfo& seqInfo, uint windowLength, std::vector<uint64>& windowCounts) const;
+
+private:
+	template<class KmerVisitor>
+	ulong visitForwardKmersGeneric(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, KmerVisitor& visitor) const;
+
+	template<uint K, class KmerVisitor>
+	ulong visitForwardKmersFixed(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, KmerVisitor& visitor) const;
+
 private:
 	byte* m_ntValues;
 	byte* m_ntReverseValues;
-	uint* m_kmerWordCount;
+	byte m_packedValues[4];
 
 	uint m_wordLength;
 
-	ulong m_numPossibleWords;
-	ulong m_topMultiplier;
+	uint64 m_numPossibleWords;
+	uint64 m_topMultiplier;
 
 	uint m_bitShift;
+
+	ulong m_numCanonicalWords;
+	uint m_canonicalShift;
+	uint m_canonicalSymbolBits;
+	uint m_canonicalRadix;
+	byte m_canonicalCode[16];
+
+	std::vector<uint> m_sortBuffer;
 };
 
+inline uint64 KmerCalculator::reverseComplement(uint64 kmer) const
+{
+	// complement bases then reverse the order of the 2-bit bases
+	uint64 x = ~kmer;
+	x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	x = ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x & 0x00FF00FF00FF00FFULL) << 8);
+	x = ((x >> 16) & 0x0000FFFF0000FFFFULL) | ((x & 0x0000FFFF0000FFFFULL) << 16);
+	x = (x >> 32) | (x << 32);
+
+	return x >> (64 - 2*m_wordLength);
+}
+
+inline uint KmerCalculator::canonicalIndex(uint kmer) const
+{
+	const uint symbolMask = (1 << m_canonicalSymbolBits) - 1;
+
+	uint64 forward = kmer;
+	uint64 reverse = reverseComplement(forward);
+
+	uint forwardSymbol = (forward >> m_canonicalShift) & symbolMask;
+	uint reverseSymbol = (reverse >> m_canonicalShift) & symbolMask;
+
+	bool bReverse = (reverseSymbol < forwardSymbol) || (reverseSymbol == forwardSymbol && reverse < forward);
+	uint64 word = bReverse ? reverse : forward;
+	uint symbol = bReverse ? reverseSymbol : forwardSymbol;
+
+	// remove unused middle symbols so canonical k-mers are densely indexed
+	uint64 upper = word >> (m_canonicalShift + m_canonicalSymbolBits);
+	uint64 lower = word & ((uint64(1) << m_canonicalShift) - 1);
+
+	return (uint)(((upper * m_canonicalRadix + m_canonicalCode[symbol]) << m_canonicalShift) | lower);
+}
+
+template<class KmerVisitor>
+ulong KmerCalculator::visitForwardKmers(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, KmerVisitor& visitor) const
+{
+	// the nucleotide encoding matches the 2-bit packed encoding, so common k-mer lengths use a loop with constant shifts and masks
+	if(m_bitShift == 2)
+	{
+		switch(m_wordLength)
+		{
+			case 4: return visitForwardKmersFixed<4>(seqStore, seqOffset, seqLength, visitor);
+			case 5: return visitForwardKmersFixed<5>(seqStore, seqOffset, seqLength, visitor);
+			case 6: return visitForwardKmersFixed<6>(seqStore, seqOffset, seqLength, visitor);
+			case 7: return visitForwardKmersFixed<7>(seqStore, seqOffset, seqLength, visitor);
+			case 8: return visitForwardKmersFixed<8>(seqStore, seqOffset, seqLength, visitor);
+			case 9: return visitForwardKmersFixed<9>(seqStore, seqOffset, seqLength, visitor);
+			case 10: return visitForwardKmersFixed<10>(seqStore, seqOffset, seqLength, visitor);
+			case 11: return visitForwardKmersFixed<11>(seqStore, seqOffset, seqLength, visitor);
+			case 12: return visitForwardKmersFixed<12>(seqStore, seqOffset, seqLength, visitor);
+			case 13: return visitForwardKmersFixed<13>(seqStore, seqOffset, seqLength, visitor);
+			case 14: return visitForwardKmersFixed<14>(seqStore, seqOffset, seqLength, visitor);
+			case 15: return visitForwardKmersFixed<15>(seqStore, seqOffset, seqLength, visitor);
+			case 16: return visitForwardKmersFixed<16>(seqStore, seqOffset, seqLength, visitor);
+		}
+	}
+
+	return visitForwardKmersGeneric(seqStore, seqOffset, seqLength, visitor);
+}
+
+template<uint K, class KmerVisitor>
+ulong KmerCalculator::visitForwardKmersFixed(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, KmerVisitor& visitor) const
+{
+	const uint64 WORD_MASK = (uint64(1) << (2*K)) - 1;
+
+	if(seqLength < K)
+		return 0;
+
+	// sequences containing ambiguous bases are handled by the generic loop
+	ulong endPos = seqOffset + seqLength;
+	uint run = seqStore.firstAmbiguousRun(seqOffset);
+	if(run < seqStore.numAmbiguousRuns() && seqStore.ambiguousRunStart(run) < endPos)
+		return visitForwardKmersGeneric(seqStore, seqOffset, seqLength, visitor);
+
+	const uint64* packedBases = seqStore.packedBases();
+
+	// bases preceding the first complete k-mer
+	ulong pos = seqOffset;
+	uint64 word = 0;
+	for(; pos < seqOffset + K - 1; ++pos)
+		word = (word << 2) | seqStore.base(pos);
+
+	// every remaining base completes a valid k-mer
+	while(pos < endPos)
+	{
+		uint64 bases = packedBases[pos / PackedSeqStore::BASES_PER_WORD] >> (2*(pos % PackedSeqStore::BASES_PER_WORD));
+		ulong wordEndPos = std::min(endPos, (pos / PackedSeqStore::BASES_PER_WORD + 1) * PackedSeqStore::BASES_PER_WORD);
+		for(; pos < wordEndPos; ++pos, bases >>= 2)
+		{
+			word = ((word << 2) | (bases & 3)) & WORD_MASK;
+			visitor(word);
+		}
+	}
+
+	return seqLength - K + 1;
+}
+
+template<class KmerVisitor>
+ulong KmerCalculator::visitForwardKmersGeneric(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, KmerVisitor& visitor) const
+{
+	if(seqLength < m_wordLength)
+		return 0;
+
+	// local copies of members so they are not reloaded after each call to the visitor
+	const uint64* packedBases = seqStore.packedBases();
+	const uint64 wordMask = m_numPossibleWords - 1;
+	const ulong wordLength = m_wordLength;
+	const uint bitShift = m_bitShift;
+	const byte packedValues[4] = { m_packedValues[0], m_packedValues[1], m_packedValues[2], m_packedValues[3] };
+
+	ulong pos = seqOffset;
+	ulong endPos = pos + seqLength;
+
+	// windows are valid once they no longer overlap an ambiguous base
+	uint run = seqStore.firstAmbiguousRun(pos);
+	ulong nextAmbiguousPos = (run < seqStore.numAmbiguousRuns()) ? seqStore.ambiguousRunStart(run) : endPos;
+	ulong validStart = pos;
+
+	ulong validKmers = 0;
+	uint64 word = 0;
+	while(pos < endPos)
+	{
+		// process all bases in current 64-bit word
+		uint64 bases = packedBases[pos / PackedSeqStore::BASES_PER_WORD] >> (2*(pos % PackedSeqStore::BASES_PER_WORD));
+		ulong wordEndPos = std::min(endPos, (pos / PackedSeqStore::BASES_PER_WORD + 1) * PackedSeqStore::BASES_PER_WORD);
+		for(; pos < wordEndPos; ++pos, bases >>= 2)
+		{
+			word = ((word << bitShift) + packedValues[bases & 3]) & wordMask;
+
+			if(pos == nextAmbiguousPos)
+			{
+				validStart = seqStore.ambiguousRunEnd(run);
+
+				++run;
+				nextAmbiguousPos = (run < seqStore.numAmbiguousRuns()) ? seqStore.ambiguousRunStart(run) : endPos;
+			}
+
+			// visit word
+			if(pos + 1 >= validStart + wordLength)
+			{
+				visitor(word);
+				++validKmers;
+			}
+		}
+	}
+
+	return validKmers;
+}
+
 #endif
\ No newline at end of file
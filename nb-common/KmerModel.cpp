@@ -22,14 +22,25 @@
 #include "stdafx.h"
 
 #include "KmerModel.hpp"
+#include "Utils.hpp"
 
 using namespace std;
 
-KmerModel::KmerModel(uint wordLength): m_kmerCalculator(new KmerCalculator(wordLength)), m_wordLength(wordLength)
+ScoringKernel KmerModel::s_scoringKernel = ::scoringKernel(AUTO_KERNEL);
+
+const uint64 KmerModel::EMPTY_SPARSE_KMER;
+const uint64 KmerModel::SPARSE_HASH_MULTIPLIER;
+
+KmerModel::KmerModel(uint wordLength, MODEL_FORMAT format)
+	: m_kmerCalculator(new KmerCalculator(wordLength)), m_logConditionalProb(NULL), m_wordLength(wordLength), m_format(format), 
+		m_sparseTableShift(64), m_numSparseKmers(0), m_unseenLogProb(0), m_deltaThreshold(0), m_gcWindowLength(0), m_numGCWindows(0), m_bValid(true)
 {
-	// store log probability of each kmer number
-	m_logConditionalProb = new float[m_kmerCalculator->numPossibleWords()];
-	memset(m_logConditionalProb, 0, m_kmerCalculator->numPossibleWords()*sizeof(float));
+	// store log probability of each kmer number, or for sparse models only observed k-mers
+	if(!sparse())
+	{
+		m_logConditionalProb = new float[m_kmerCalculator->numPossibleWords()];
+		memset(m_logConditionalProb, 0, m_kmerCalculator->numPossibleWords()*sizeof(float));
+	}
 }
 
 KmerModel::KmerModel(const std::string& modelFile)
@@ -69,6 +80,22 @@ bool KmerModel::constructModel(SeqInfo& seqInfo)
 		}
 	}
 
+	if(m_gcWindowLength > 0)
+	{
+		m_kmerCalculator->gcWindowCounts(seqInfo, m_gcWindowLength, m_gcWindowCounts);
+		updateGCDistribution();
+	}
+
+	// k-mers of sparse models are counted once all sequences have been processed
+	if(sparse())
+	{
+		m_kmerCalculator->extractKmers(seqInfo, m_observedKmers);
+		m_modelInfo.numWords += seqInfo.validKmers;
+		m_modelInfo.numSeqs++;
+
+		return true;
+	}
+
 	// calculate kmer profile for sequence
 	std::vector<uint> kmerVector;
 	m_kmerCalculator->extractKmers(seqInfo, kmerVector);
@@ -85,6 +112,33 @@ bool KmerModel::constructModel(SeqInfo& seqInfo)
 
 void KmerModel::calculateConditionalProbabilities()
 {
+	if(sparse())
+	{
+		// count each distinct k-mer, where unobserved k-mers receive only the pseudocount
+		std::sort(m_observedKmers.begin(), m_observedKmers.end());
+
+		std::vector<uint64> kmers;
+		std::vector<float> logProbs;
+		for(ulong i = 0; i < m_observedKmers.size(); )
+		{
+			ulong j = i + 1;
+			while(j < m_observedKmers.size() && m_observedKmers[j] == m_observedKmers[i])
+				++j;
+
+			float count = j - i;
+			kmers.push_back(m_observedKmers[i]);
+			logProbs.push_back(log((count + 1.0f) / (m_modelInfo.numWords + m_kmerCalculator->numPossibleWords())));
+
+			i = j;
+		}
+		m_unseenLogProb = log(1.0f / (m_modelInfo.numWords + m_kmerCalculator->numPossibleWords()));
+
+		std::vector<uint64>().swap(m_observedKmers);
+		buildSparseTable(kmers, logProbs);
+
+		return;
+	}
+
 	// calculate log conditional probabilities
 	for(uint i = 0; i < m_kmerCalculator->numPossibleWords(); ++i)
 	{
@@ -93,24 +147,198 @@ void KmerModel::calculateConditionalProbabilities()
 	}
 }
 
+bool KmerModel::makeCanonical()
+{
+	if(canonical())
+		return true;
+
+	if(m_format != DENSE_MODEL || !m_kmerCalculator->supportsCanonical())
+		return false;
+
+	// a k-mer and its reverse complement have the same probability when trained on both strands;
+	// for even n-mer lengths some indices are never assigned, so the table is cleared first
+	float* canonicalProb = new float[m_kmerCalculator->numCanonicalWords()];
+	memset(canonicalProb, 0, sizeof(float) * m_kmerCalculator->numCanonicalWords());
+	for(uint i = 0; i < m_kmerCalculator->numPossibleWords(); ++i)
+		canonicalProb[m_kmerCalculator->canonicalIndex(i)] = m_logConditionalProb[i];
+
+	delete[] m_logConditionalProb;
+	m_logConditionalProb = canonicalProb;
+	m_format = CANONICAL_MODEL;
+
+	return true;
+}
+
+ulong KmerModel::tableSize() const
+{
+	if(sparse())
+		return m_numSparseKmers;
+
+	if(delta())
+		return numDeltas();
+
+	return canonical() ? m_kmerCalculator->numCanonicalWords() : m_kmerCalculator->numPossibleWords();
+}
+
+void KmerModel::buildSparseTable(const std::vector<uint64>& kmers, const std::vector<float>& logProbs)
+{
+	// table has a power of 2 size that is at least twice the number of k-mers
+	ulong tableSize = 2;
+	m_sparseTableShift = 63;
+	while(tableSize < 2*kmers.size())
+	{
+		tableSize *= 2;
+		m_sparseTableShift--;
+	}
+
+	SparseEntry emptyEntry;
+	emptyEntry.kmer = EMPTY_SPARSE_KMER;
+	emptyEntry.logProb = m_unseenLogProb;
+	m_sparseTable.assign(tableSize, emptyEntry);
+
+	m_numSparseKmers = kmers.size();
+
+	const uint64 mask = tableSize - 1;
+	for(ulong i = 0; i < kmers.size(); ++i)
+	{
+		uint64 index = (kmers[i] * SPARSE_HASH_MULTIPLIER) >> m_sparseTableShift;
+		while(m_sparseTable[index].kmer != EMPTY_SPARSE_KMER)
+			index = (index + 1) & mask;
+
+		m_sparseTable[index].kmer = kmers[i];
+		m_sparseTable[index].logProb = logProbs[i];
+	}
+}
+
+// Sums the log probability of each k-mer in a sequence
+struct ModelKmerScorer
+{
+	ModelKmerScorer(const KmerModel& _model, const float* _logProb, const KmerCalculator& _kmerCalculator)
+		: model(_model), logProb(_logProb), kmerCalculator(_kmerCalculator), sum(0) {}
+
+	void operator()(uint64 kmer)
+	{
+		if(model.sparse())
+			sum += model.sparseLogProb(kmer);
+		else if(model.canonical())
+			sum += logProb[kmerCalculator.canonicalIndex((uint)kmer)];
+		else
+			sum += logProb[kmer];
+	}
+
+	const KmerModel& model;
+	const float* logProb;
+	const KmerCalculator& kmerCalculator;
+	float sum;
+};
+
+float KmerModel::classify(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, ulong& validKmers) const
+{
+	ModelKmerScorer scorer(*this, m_logConditionalProb, *m_kmerCalculator);
+	validKmers = m_kmerCalculator->visitForwardKmers(seqStore, seqOffset, seqLength, scorer);
+
+	return scorer.sum;
+}
+
+void KmerModel::gcWindowLength(uint windowLength)
+{
+	m_gcWindowLength = windowLength;
+	m_gcWindowCounts.assign(windowLength + 1, 0);
+	updateGCDistribution();
+}
+
+void KmerModel::updateGCDistribution()
+{
+	m_gcCumulativeCounts.assign(m_gcWindowCounts.size() + 1, 0);
+	for(uint i = 0; i < m_gcWindowCounts.size(); ++i)
+		m_gcCumulativeCounts[i + 1] = m_gcCumulativeCounts[i] + m_gcWindowCounts[i];
+
+	m_numGCWindows = m_gcCumulativeCounts.back();
+}
+
+double KmerModel::gcTailProbability(double gcFraction) const
+{
+	if(!hasGCDistribution())
+		return 1.0;
+
+	// windows with exactly the given GC content are counted in both tails
+	double gcBases = gcFraction * m_gcWindowLength;
+	uint lowerBin = (uint)std::min(ceil(gcBases - 1e-6), (double)m_gcWindowLength);
+	uint upperBin = (uint)std::max(floor(gcBases + 1e-6), 0.0);
+
+	uint64 lowerCount = m_gcCumulativeCounts[lowerBin + 1];
+	uint64 upperCount = m_numGCWindows - m_gcCumulativeCounts[upperBin];
+
+	// the smaller tail is doubled to give a two-sided probability
+	return std::min(2.0 * std::min(lowerCount, upperCount) / m_numGCWindows, 1.0);
+}
+
+void KmerModel::logConditionalProb(const float* logProb)
+{
+	memcpy(m_logConditionalProb, logProb, tableSize()*sizeof(float));
+}
+
+bool KmerModel::makeDelta(const KmerModel& nullModel, float threshold)
+{
+	if(m_format != DENSE_MODEL || nullModel.m_format != DENSE_MODEL || nullModel.m_wordLength != m_wordLength)
+		return false;
+
+	m_deltaKmers.clear();
+	m_deltaLogProbs.clear();
+	for(uint64 i = 0; i < m_kmerCalculator->numPossibleWords(); ++i)
+	{
+		float delta = m_logConditionalProb[i] - nullModel.m_logConditionalProb[i];
+		if(fabs(delta) > threshold)
+		{
+			m_deltaKmers.push_back(i);
+			m_deltaLogProbs.push_back(delta);
+		}
+	}
+
+	delete[] m_logConditionalProb;
+	m_logConditionalProb = NULL;
+	m_deltaThreshold = threshold;
+	m_format = DELTA_MODEL;
+
+	return true;
+}
+
 float KmerModel::classify(SeqInfo& seqInfo) 
 {
+	if(sparse())
+	{
+		PackedSeqStore seqStore;
+		seqStore.add(seqInfo.seq, seqInfo.length);
+
+		return classify(seqStore, 0, seqInfo.length, seqInfo.validKmers);
+	}
+
 	std::vector<uint> kmers;
 	m_kmerCalculator->extractForwardKmers(seqInfo, kmers);
+	if(canonical() && !kmers.empty())
+		m_kmerCalculator->canonicalIndices(&kmers[0], kmers.size());
 
-	return classify(seqInfo, kmers); 
+	return classify(KmerSpan(kmers)); 
 }
 
-
-float KmerModel::classify(const SeqInfo& seqInfo, const std::vector<uint>& profile) 
+void KmerModel::classify(const std::vector<KmerSpan>& profiles, uint groupSize, std::vector<float>& logLikelihoods) const
 {
-	float logProb = 0.0f;
-	for(ulong i = 0; i < seqInfo.validKmers; ++i)
-		logProb += m_logConditionalProb[profile.at(i)];
+	logLikelihoods.resize(profiles.size());
+	if(profiles.empty())
+		return;
+
+	// compacted profiles are already visited in ascending k-mer order so are scored individually
+	if(groupSize > 1 && !profiles[0].counts)
+	{
+		scoreInterleaved(m_logConditionalProb, &profiles[0], profiles.size(), groupSize, &logLikelihoods[0]);
+		return;
+	}
 
-	return logProb;
+	for(uint i = 0; i < profiles.size(); ++i)
+		logLikelihoods[i] = classify(profiles[i]);
 }
 
+
 void KmerModel::write(const std::string& filename) const
 {
 	std::ofstream fout(filename.c_str(), std::ios::out | std::ios::binary);
@@ -120,7 +348,8 @@ void KmerModel::write(const std::string& filename) const
 		return;
 	}
 
-	fout.write((char*)&m_wordLength, sizeof(uint));
+	uint lengthField = m_wordLength | (m_format << MODEL_FORMAT_SHIFT);
+	fout.write((char*)&lengthField, sizeof(uint));
 
 	size_t size = m_modelInfo.name.size();
 	fout.write((char*)&size, sizeof(size_t));
@@ -158,76 +387,189 @@ void KmerModel::write(const std::string& filename) const
 	fout.write((char*)&size, sizeof(size_t));
 	fout.write(m_modelInfo.taxonomy.strain.c_str(), m_modelInfo.taxonomy.strain.size());
 
-	fout.write((char*)m_logConditionalProb, sizeof(float)*m_kmerCalculator->numPossibleWords());
+	if(sparse())
+	{
+		// observed k-mers are written in sorted order followed by their log probabilities
+		std::vector<SparseEntry> entries;
+		for(ulong i = 0; i < m_sparseTable.size(); ++i)
+		{
+			if(m_sparseTable[i].kmer != EMPTY_SPARSE_KMER)
+				entries.push_back(m_sparseTable[i]);
+		}
+		std::sort(entries.begin(), entries.end());
+
+		uint64 numKmers = entries.size();
+		fout.write((char*)&numKmers, sizeof(uint64));
+		fout.write((char*)&m_unseenLogProb, sizeof(float));
+		for(ulong i = 0; i < entries.size(); ++i)
+			fout.write((char*)&entries[i].kmer, sizeof(uint64));
+		for(ulong i = 0; i < entries.size(); ++i)
+			fout.write((char*)&entries[i].logProb, sizeof(float));
+	}
+	else if(delta())
+	{
+		uint64 numKmers = m_deltaKmers.size();
+		fout.write((char*)&numKmers, sizeof(uint64));
+		fout.write((char*)&m_deltaThreshold, sizeof(float));
+		if(numKmers > 0)
+		{
+			fout.write((char*)&m_deltaKmers[0], sizeof(uint64) * numKmers);
+			fout.write((char*)&m_deltaLogProbs[0], sizeof(float) * numKmers);
+		}
+	}
+	else
+		fout.write((char*)m_logConditionalProb, sizeof(float)*tableSize());
+
+	if(m_gcWindowLength > 0)
+	{
+		fout.write((char*)&m_gcWindowLength, sizeof(uint));
+		fout.write((char*)&m_gcWindowCounts[0], sizeof(uint64)*(m_gcWindowLength + 1));
+	}
 
 	fout.close();
 }
 
-void KmerModel::read(const std::string& filename)
+void KmerModel::readHeader(std::istream& fin, uint& lengthField, std::string& name, TaxonomyModel& taxonomy)
 {
-	std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
-	if(!fin.is_open())
+	fin.read((char*)&lengthField, sizeof(uint));
+
+	std::string* fields[] = { &name, &taxonomy.superKingdom, &taxonomy.phylum, &taxonomy.taxonomicClass, &taxonomy.order, 
+														&taxonomy.family, &taxonomy.genus, &taxonomy.species, &taxonomy.strain };
+	for(uint i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
 	{
-		std::cout << "Failed to read model from file: " << filename << "." << std::endl;
-		return;
+		if(!readName(fin, *fields[i]))
+		{
+			fin.setstate(std::ios::failbit);
+			return;
+		}
 	}
+}
 
-	fin.read((char*)&m_wordLength, sizeof(uint));
-
-	size_t size;
-	char buffer[1024];
+bool KmerModel::readTaxonomy(const std::string& modelFile, TaxonomyModel& taxonomy)
+{
+	std::ifstream fin(modelFile.c_str(), std::ios::in | std::ios::binary);
+	if(!fin.is_open())
+		return false;
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.name = buffer;
+	uint lengthField;
+	std::string name;
+	readHeader(fin, lengthField, name, taxonomy);
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.superKingdom = buffer;
+	return !fin.fail();
+}
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.phylum = buffer;
+bool KmerModel::readModelName(const std::string& modelFile, std::string& name)
+{
+	std::ifstream fin(modelFile.c_str(), std::ios::in | std::ios::binary);
+	if(!fin.is_open())
+		return false;
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.taxonomicClass = buffer;
+	uint lengthField;
+	TaxonomyModel taxonomy;
+	readHeader(fin, lengthField, name, taxonomy);
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.order = buffer;
+	return !fin.fail();
+}
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.family = buffer;
+bool KmerModel::read(const std::string& filename)
+{
+	// members are initialized first so an invalid model can be safely destroyed
+	m_kmerCalculator = NULL;
+	m_logConditionalProb = NULL;
+	m_wordLength = 0;
+	m_format = DENSE_MODEL;
+	m_sparseTableShift = 64;
+	m_numSparseKmers = 0;
+	m_unseenLogProb = 0;
+	m_deltaThreshold = 0;
+	m_gcWindowLength = 0;
+	m_numGCWindows = 0;
+	m_bValid = false;
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.genus = buffer;
+	std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!fin.is_open())
+	{
+		std::cout << "Failed to read model from file: " << filename << "." << std::endl;
+		return false;
+	}
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.species = buffer;
+	uint lengthField;
+	readHeader(fin, lengthField, m_modelInfo.name, m_modelInfo.taxonomy);
+	uint wordLength = lengthField & ((1 << MODEL_FORMAT_SHIFT) - 1);
+	uint format = lengthField >> MODEL_FORMAT_SHIFT;
 
-	fin.read((char*)&size, sizeof(size_t));
-	fin.read(buffer, size);
-	buffer[size] = 0;
-	m_modelInfo.taxonomy.strain = buffer;
+	// dense tables and the delta index hold every n-mer so their n-mer length is limited
+	uint maxWordLength = (format == SPARSE_MODEL) ? KmerCalculator::MAX_KMER_LENGTH : MAX_DENSE_KMER_LENGTH;
+	if(fin.fail() || format > DELTA_MODEL || wordLength < 1 || wordLength > maxWordLength)
+	{
+		std::cout << "Invalid model file: " << filename << "." << std::endl;
+		return false;
+	}
 
+	m_wordLength = wordLength;
+	m_format = (MODEL_FORMAT)format;
 	m_kmerCalculator = new KmerCalculator(m_wordLength);
-	m_logConditionalProb = new float[m_kmerCalculator->numPossibleWords()];
 
-	fin.read((char*)m_logConditionalProb, sizeof(float) * m_kmerCalculator->numPossibleWords());
+	// sizes are checked against the remainder of the file before anything is allocated
+	bool bValid = true;
+	if(delta())
+	{
+		uint64 numKmers;
+		fin.read((char*)&numKmers, sizeof(uint64));
+		fin.read((char*)&m_deltaThreshold, sizeof(float));
+
+		bValid = !fin.fail() && readArray(fin, m_deltaKmers, numKmers) && readArray(fin, m_deltaLogProbs, numKmers);
+		for(ulong i = 0; bValid && i < numKmers; ++i)
+			bValid = m_deltaKmers[i] < m_kmerCalculator->numPossibleWords();
+	}
+	else if(sparse())
+	{
+		uint64 numKmers;
+		fin.read((char*)&numKmers, sizeof(uint64));
+		fin.read((char*)&m_unseenLogProb, sizeof(float));
+
+		std::vector<uint64> kmers;
+		std::vector<float> logProbs;
+		bValid = !fin.fail() && readArray(fin, kmers, numKmers) && readArray(fin, logProbs, numKmers);
+		if(bValid)
+			buildSparseTable(kmers, logProbs);
+	}
+	else
+	{
+		bValid = (tableSize() <= bytesRemaining(fin) / sizeof(float));
+		if(bValid)
+		{
+			m_logConditionalProb = new float[tableSize()];
+			fin.read((char*)m_logConditionalProb, sizeof(float) * tableSize());
+			bValid = !fin.fail();
+		}
+	}
+
+	if(!bValid)
+	{
+		std::cout << "Invalid model file: " << filename << "." << std::endl;
+		return false;
+	}
+
+	// GC distribution is optional
+	m_gcWindowCounts.clear();
+
+	uint gcWindowLength;
+	if(fin.read((char*)&gcWindowLength, sizeof(uint)) && gcWindowLength > 0)
+	{
+		std::vector<uint64> gcWindowCounts;
+		if(readArray(fin, gcWindowCounts, (uint64)gcWindowLength + 1))
+		{
+			m_gcWindowLength = gcWindowLength;
+			m_gcWindowCounts.swap(gcWindowCounts);
+		}
+	}
+	updateGCDistribution();
 
 	fin.close();
+
+	m_bValid = true;
+	return true;
 }
 
 void KmerModel::printModelInfo(std::ostream& out) const
@@ -235,4 +577,12 @@ void KmerModel::printModelInfo(std::ostream& out) const
 	out << "Model name: " << m_modelInfo.name << std::endl;
 	out << "Model taxonomy: " << m_modelInfo.taxonomy.taxonomyStr() << std::endl;
 	out << "N-mer length: " << m_wordLength << std::endl;
+	if(sparse())
+		out << "Model format: sparse (" << tableSize() << " observed n-mers)" << std::endl;
+	else if(delta())
+		out << "Model format: delta (" << numDeltas() << " n-mers differ from null model by more than " << m_deltaThreshold << ")" << std::endl;
+	else
+		out << "Model format: " << (canonical() ? "canonical" : "dense") << std::endl;
+	if(hasGCDistribution())
+		out << "GC distribution: " << m_numGCWindows << " windows of " << m_gcWindowLength << " bp" << std::endl;
 }
\ No newline at end of file
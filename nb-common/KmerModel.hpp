@@ -25,14 +25,26 @@
 #include "stdafx.h"
 
 #include "KmerCalculator.hpp"
+#include "ScoringKernels.hpp"
 
 class KmerModel
 {
 public:
 	static const byte INVALID_NT_CHARACTER = 255;
 
+	// Models either store a probability for every k-mer, only for canonical k-mers, only for k-mers 
+	// observed during training (sparse), or only for k-mers whose probability differs substantially 
+	// from a null model (delta). The format is stored in the high byte of the n-mer length field so 
+	// earlier model files are read as dense models.
+	enum MODEL_FORMAT { DENSE_MODEL = 0, CANONICAL_MODEL = 1, SPARSE_MODEL = 2, DELTA_MODEL = 3 };
+	static const uint MODEL_FORMAT_SHIFT = 24;
+
+	// longest k-mer for which a dense table is practical (4^13 floats = 256 MB)
+	static const uint MAX_DENSE_KMER_LENGTH = 13;
+
 public:
-	KmerModel(uint wordLength);
+	KmerModel(uint wordLength, MODEL_FORMAT format = DENSE_MODEL);
+	// models read from a file must be checked with valid() before use
 	KmerModel(const std::string& modelFile);
 
 	~KmerModel();
@@ -41,22 +53,88 @@ public:
 
 	void calculateConditionalProbabilities();
 
+	// store only canonical k-mers, which requires the model to have been trained on both strands
+	bool makeCanonical();
+	bool canonical() const { return m_format == CANONICAL_MODEL; }
+
+	// sparse models hold 64-bit k-mers in an open addressing hash table and support k-mers of up to 31 bases
+	bool sparse() const { return m_format == SPARSE_MODEL; }
+	float sparseLogProb(uint64 kmer) const;
+
+	// Delta models store log P(k-mer | model) - log P(k-mer | null model) for k-mers where the magnitude 
+	// of this difference exceeds a threshold. All other k-mers are assumed to have the null model probability.
+	// Delta models must be applied together with their null model (see DeltaIndex).
+	bool makeDelta(const KmerModel& nullModel, float threshold);
+	bool delta() const { return m_format == DELTA_MODEL; }
+	float deltaThreshold() const { return m_deltaThreshold; }
+	ulong numDeltas() const { return m_deltaKmers.size(); }
+	uint64 deltaKmer(ulong index) const { return m_deltaKmers[index]; }
+	float deltaLogProb(ulong index) const { return m_deltaLogProbs[index]; }
+
+	// Distribution of GC content over all windows of a fixed length in the training sequences. It is 
+	// recorded when a window length is set before the model is constructed and is stored after the 
+	// log probabilities, where it is ignored by earlier versions.
+	void gcWindowLength(uint windowLength);
+	uint gcWindowLength() const { return m_gcWindowLength; }
+	bool hasGCDistribution() const { return m_gcWindowLength > 0 && m_numGCWindows > 0; }
+
+	// two-sided probability of a training window with GC content at least as extreme as the given fraction,
+	// which is twice the smaller tail (at most 1)
+	double gcTailProbability(double gcFraction) const;
+
+	// number of entries in the table of log probabilities
+	ulong tableSize() const;
+
 	float classify(SeqInfo& seqInfo);
-	float classify(const SeqInfo& seqInfo, const std::vector<uint>& profile);
+	float classify(const KmerSpan& profile) const
+	{ 
+		if(profile.counts)
+			return scoreCounted(m_logConditionalProb, profile.kmers, profile.counts, profile.numKmers);
+
+		return s_scoringKernel(m_logConditionalProb, profile.kmers, profile.numKmers); 
+	}
+	void classify(const std::vector<KmerSpan>& profiles, uint groupSize, std::vector<float>& logLikelihoods) const;
+
+	// score a packed sequence directly, as required for sparse models
+	float classify(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, ulong& validKmers) const;
+
+	// set kernel used to score all models
+	static void scoringKernel(SCORING_KERNEL kernel) { s_scoringKernel = ::scoringKernel(kernel); }
 
 	void write(const std::string& filename) const;
 	
 	TaxonomyModel taxonomy() const { return m_modelInfo.taxonomy; }
 
+	// taxonomy of a model read from the start of its file without reading its tables
+	static bool readTaxonomy(const std::string& modelFile, TaxonomyModel& taxonomy);
+
+	// name of a model read from the start of its file without reading its tables
+	static bool readModelName(const std::string& modelFile, std::string& name);
+
 	void name(const std::string& name) { m_modelInfo.name = name; }
 	std::string name() const { return m_modelInfo.name; }
 	
 	uint kmerLength() const { return m_wordLength; }
 
+	// false if the model file could not be read or is malformed
+	bool valid() const { return m_bValid; }
+
+	const float* logConditionalProb() const { return m_logConditionalProb; }
+
+	// replace the tableSize() log probabilities of a dense or canonical model, such as with a combination of other models
+	void logConditionalProb(const float* logProb);
+
 	void printModelInfo(std::ostream& out) const;
 
 private:
-	void read(const std::string& filename);
+	bool read(const std::string& filename);
+
+	// length and format field, name, and taxonomy at the start of a model file
+	static void readHeader(std::istream& fin, uint& lengthField, std::string& name, TaxonomyModel& taxonomy);
+
+	void buildSparseTable(const std::vector<uint64>& kmers, const std::vector<float>& logProbs);
+
+	void updateGCDistribution();
 
 private:
 	struct ModelInfo
@@ -74,7 +152,20 @@ private:
 		ulong numSeqs;
 	};
 
+	struct SparseEntry
+	{
+		bool operator<(const SparseEntry& entry) const { return kmer < entry.kmer; }
+
+		uint64 kmer;
+		float logProb;
+	};
+
+	static const uint64 EMPTY_SPARSE_KMER = ~0ULL;
+	static const uint64 SPARSE_HASH_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+
 private:
+	static ScoringKernel s_scoringKernel;
+
 	ModelInfo m_modelInfo;
 
 	KmerCalculator* m_kmerCalculator;
@@ -82,6 +173,48 @@ private:
 	float* m_logConditionalProb;
 
 	uint m_wordLength;
+	MODEL_FORMAT m_format;
+
+	// k-mers on both strands of training sequences for sparse models
+	std::vector<uint64> m_observedKmers;
+
+	std::vector<SparseEntry> m_sparseTable;
+	uint m_sparseTableShift;
+	ulong m_numSparseKmers;
+	float m_unseenLogProb;
+
+	// differences from null model in order of increasing k-mer
+	std::vector<uint64> m_deltaKmers;
+	std::vector<float> m_deltaLogProbs;
+	float m_deltaThreshold;
+
+	// number of training windows with each possible number of G or C bases
+	uint m_gcWindowLength;
+	std::vector<uint64> m_gcWindowCounts;
+	uint64 m_numGCWindows;
+
+	// number of windows with fewer than i G or C bases
+	std::vector<uint64> m_gcCumulativeCounts;
+
+	bool m_bValid;
 };
 
+inline float KmerModel::sparseLogProb(uint64 kmer) const
+{
+	// linear probing, where the table is at most half full so an empty entry is always reached
+	const uint64 mask = m_sparseTable.size() - 1;
+	uint64 index = (kmer * SPARSE_HASH_MULTIPLIER) >> m_sparseTableShift;
+	while(true)
+	{
+		const SparseEntry& entry = m_sparseTable[index];
+		if(entry.kmer == kmer)
+			return entry.logProb;
+
+		if(entry.kmer == EMPTY_SPARSE_KMER)
+			return m_unseenLogProb;
+
+		index = (index + 1) & mask;
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "KmerProfileArena.hpp"
+
+KmerProfileArena::KmerProfileArena()
+{
+	clear();
+}
+
+void KmerProfileArena::clear()
+{
+	// arrays are never shrunk so the arena can be reused for each batch of fragments
+	m_offsets.clear();
+	m_offsets.push_back(0);
+
+	m_bCounts = false;
+}
+
+void KmerProfileArena::reserve(ulong numKmers)
+{
+	if(m_kmers.size() < numKmers)
+		m_kmers.resize(numKmers);
+}
+
+uint* KmerProfileArena::beginProfile(ulong maxKmers)
+{
+	ulong end = m_offsets.back() + maxKmers;
+	if(m_kmers.size() < end)
+		m_kmers.resize(std::max(end, 2*m_kmers.size()));
+
+	return m_kmers.empty() ? NULL : &m_kmers[m_offsets.back()];
+}
+
+uint* KmerProfileArena::beginCounts()
+{
+	m_bCounts = true;
+
+	if(m_counts.size() < m_kmers.size())
+		m_counts.resize(m_kmers.size());
+
+	return m_counts.empty() ? NULL : &m_counts[m_offsets.back()];
+}
+
+void KmerProfileArena::endProfile(ulong numKmers)
+{
+	m_offsets.push_back(m_offsets.back() + numKmers);
+}
+
+KmerSpan KmerProfileArena::profile(uint index) const
+{
+	KmerSpan span(&m_kmers[0] + m_offsets[index], m_offsets[index+1] - m_offsets[index]);
+	if(m_bCounts)
+		span.counts = &m_counts[0] + m_offsets[index];
+
+	return span;
+}
+
+ulong KmerProfileArena::memoryUsage() const
+{
+	return (m_kmers.size() + m_counts.size())*sizeof(uint) + m_offsets.size()*sizeof(ulong);
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef KMER_PROFILE_ARENA
+#define KMER_PROFILE_ARENA
+
+#include "stdafx.h"
+
+// K-mer profiles of a batch of fragments stored back to back in a single array with
+// an offset per profile. Memory is retained between batches so profiles can be built
+// without allocating memory for each fragment.
+class KmerProfileArena
+{
+public:
+	KmerProfileArena();
+
+	void clear();
+
+	// ensure profiles with a total of numKmers k-mers can be added without growing the arena
+	void reserve(ulong numKmers);
+
+	// space for at most maxKmers k-mers at the end of the arena, valid until the next call
+	uint* beginProfile(ulong maxKmers);
+
+	// space for the count of each k-mer in the profile being built
+	uint* beginCounts();
+
+	// complete the profile being built using its first numKmers k-mers
+	void endProfile(ulong numKmers);
+
+	uint size() const { return m_offsets.size() - 1; }
+
+	// views remain valid until the arena is next modified
+	KmerSpan profile(uint index) const;
+
+	ulong memoryUsage() const;
+
+private:
+	std::vector<uint> m_kmers;
+	std::vector<uint> m_counts;
+	std::vector<ulong> m_offsets;
+
+	bool m_bCounts;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,156 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "LowRankModel.hpp"
+#include "KmerCalculator.hpp"
+#include "KmerModel.hpp"
+#include "Utils.hpp"
+
+LowRankModel::LowRankModel()
+	: m_wordLength(0), m_bCanonical(false), m_rank(0)
+{
+
+}
+
+void LowRankModel::set(uint wordLength, bool bCanonical, uint rank, const std::vector<float>& basis, 
+												const std::vector<float>& coefficients, const std::vector<std::string>& modelNames)
+{
+	m_wordLength = wordLength;
+	m_bCanonical = bCanonical;
+	m_rank = rank;
+	m_basis = basis;
+	m_coefficients = coefficients;
+	m_modelNames = modelNames;
+}
+
+void LowRankModel::write(const std::string& filename) const
+{
+	std::ofstream fout(filename.c_str(), std::ios::out | std::ios::binary);
+	if(!fout.is_open())
+	{
+		std::cout << "Failed to write low-rank model to file: " << filename << "." << std::endl;
+		return;
+	}
+
+	writeFileHeader(fout, "NBLR", FORMAT_VERSION);
+
+	fout.write((char*)&m_wordLength, sizeof(uint));
+	uint canonical = m_bCanonical ? 1 : 0;
+	fout.write((char*)&canonical, sizeof(uint));
+	fout.write((char*)&m_rank, sizeof(uint));
+
+	uint numModels = m_modelNames.size();
+	fout.write((char*)&numModels, sizeof(uint));
+	for(uint i = 0; i < numModels; ++i)
+		writeName(fout, m_modelNames[i]);
+
+	uint64 basisSize = m_basis.size();
+	fout.write((char*)&basisSize, sizeof(uint64));
+	fout.write((char*)&m_basis[0], sizeof(float)*basisSize);
+	fout.write((char*)&m_coefficients[0], sizeof(float)*m_coefficients.size());
+
+	fout.close();
+}
+
+bool LowRankModel::read(const std::string& filename)
+{
+	std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!fin.is_open())
+	{
+		std::cout << "Failed to read low-rank model from file: " << filename << "." << std::endl;
+		return false;
+	}
+
+	uint canonical, numModels;
+	bool bValid = readFileHeader(fin, "NBLR", FORMAT_VERSION);
+	fin.read((char*)&m_wordLength, sizeof(uint));
+	fin.read((char*)&canonical, sizeof(uint));
+	fin.read((char*)&m_rank, sizeof(uint));
+	fin.read((char*)&numModels, sizeof(uint));
+	m_bCanonical = (canonical != 0);
+
+	// sizes are checked against the remainder of the file before anything is allocated
+	bValid = bValid && !fin.fail() && m_wordLength >= 1 && m_wordLength <= KmerModel::MAX_DENSE_KMER_LENGTH;
+	bValid = bValid && m_rank < bytesRemaining(fin) / sizeof(float) && numModels <= bytesRemaining(fin) / sizeof(size_t);
+	if(bValid)
+	{
+		m_modelNames.resize(numModels);
+		for(uint i = 0; i < numModels && bValid; ++i)
+			bValid = readName(fin, m_modelNames[i]);
+	}
+
+	uint64 basisSize = 0;
+	fin.read((char*)&basisSize, sizeof(uint64));
+	bValid = bValid && !fin.fail();
+	if(bValid)
+	{
+		// the basis must cover every entry of the table it approximates since projections index it by k-mer
+		KmerCalculator kmerCalculator(m_wordLength);
+		uint64 tableSize = m_bCanonical ? kmerCalculator.numCanonicalWords() : kmerCalculator.numPossibleWords();
+		bValid = (basisSize == tableSize * (m_rank + 1));
+	}
+	bValid = bValid && readArray(fin, m_basis, basisSize);
+	bValid = bValid && readArray(fin, m_coefficients, (uint64)numModels * (m_rank + 1));
+	if(!bValid)
+	{
+		std::cout << "Invalid low-rank model file: " << filename << "." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void LowRankModel::project(const KmerSpan& profile, float* projection) const
+{
+	const uint width = m_rank + 1;
+	for(uint j = 0; j < width; ++j)
+		projection[j] = 0.0f;
+
+	const float* basis = &m_basis[0];
+	for(ulong i = 0; i < profile.numKmers; ++i)
+	{
+		const float* row = basis + (ulong)profile.kmers[i] * width;
+		float count = profile.counts ? (float)profile.counts[i] : 1.0f;
+		for(uint j = 0; j < width; ++j)
+			projection[j] += count * row[j];
+	}
+}
+
+void LowRankModel::logLikelihoods(const float* projection, float* logLikelihoods) const
+{
+	const uint width = m_rank + 1;
+	const float* coefficients = &m_coefficients[0];
+	for(uint m = 0; m < numModels(); ++m)
+	{
+		const float* modelCoefficients = coefficients + (ulong)m * width;
+		float sum = 0.0f;
+		for(uint j = 0; j < width; ++j)
+			sum += modelCoefficients[j] * projection[j];
+		logLikelihoods[m] = sum;
+	}
+}
+
+ulong LowRankModel::memoryUsage() const
+{
+	return (m_basis.size() + m_coefficients.size())*sizeof(float);
+}
\ No newline at end of file
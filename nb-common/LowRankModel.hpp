@@ -0,0 +1,81 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef LOW_RANK_MODEL
+#define LOW_RANK_MODEL
+
+#include "stdafx.h"
+
+// Approximation of the log probability tables of a set of models by a mean table and a small 
+// number of basis tables (see nb-compress). The table of model m is approximated as
+//
+//   log P(k-mer | m) ~ mean[k-mer] + sum_j coefficient[m][j] * basis[j][k-mer]
+//
+// so the log likelihood of a fragment under every model follows from projecting the k-mers of
+// the fragment onto the mean and basis tables once, and taking a small product with the 
+// coefficients of each model. The mean is stored as the first column of the basis with a 
+// coefficient of 1 so projections and coefficients are vectors of rank + 1 values.
+class LowRankModel
+{
+public:
+	// files start with the magic number "NBLR" and this version
+	static const uint FORMAT_VERSION = 1;
+
+public:
+	LowRankModel();
+
+	// basis holds rank + 1 values per table entry (mean first), coefficients hold rank + 1 values per model
+	void set(uint wordLength, bool bCanonical, uint rank, const std::vector<float>& basis, 
+							const std::vector<float>& coefficients, const std::vector<std::string>& modelNames);
+
+	bool read(const std::string& filename);
+	void write(const std::string& filename) const;
+
+	uint kmerLength() const { return m_wordLength; }
+	bool canonical() const { return m_bCanonical; }
+	uint rank() const { return m_rank; }
+
+	uint numModels() const { return m_modelNames.size(); }
+	const std::string& name(uint modelIndex) const { return m_modelNames[modelIndex]; }
+
+	// projection of a profile onto the mean and basis tables (rank + 1 values)
+	void project(const KmerSpan& profile, float* projection) const;
+
+	// approximate log likelihood of each model given the projection of a profile
+	void logLikelihoods(const float* projection, float* logLikelihoods) const;
+
+	ulong memoryUsage() const;
+
+private:
+	uint m_wordLength;
+	bool m_bCanonical;
+	uint m_rank;
+
+	// rank + 1 values for each k-mer
+	std::vector<float> m_basis;
+
+	// rank + 1 values for each model
+	std::vector<float> m_coefficients;
+
+	std::vector<std::string> m_modelNames;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,94 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "ModelBlock.hpp"
+
+BlockScoringKernel ModelBlock::s_blockScoringKernel = ::blockScoringKernel(AUTO_KERNEL);
+
+ModelBlock::ModelBlock()
+	: m_numModels(0)
+{
+
+}
+
+void ModelBlock::set(const std::vector<KmerModel*>& models, uint firstModel, uint numModels)
+{
+	m_numModels = numModels;
+
+	ulong tableSize = models[firstModel]->tableSize();
+	m_logProb.resize(tableSize * MODEL_BLOCK_WIDTH);
+
+	// memory is retained between blocks, so unused columns are cleared explicitly
+	for(uint m = 0; m < MODEL_BLOCK_WIDTH; ++m)
+	{
+		float* column = &m_logProb[m];
+		if(m < numModels)
+		{
+			const float* logProb = models[firstModel + m]->logConditionalProb();
+			for(ulong i = 0; i < tableSize; ++i)
+				column[i * MODEL_BLOCK_WIDTH] = logProb[i];
+		}
+		else
+		{
+			for(ulong i = 0; i < tableSize; ++i)
+				column[i * MODEL_BLOCK_WIDTH] = 0.0f;
+		}
+	}
+}
+
+void ModelBlock::classifyRange(const std::vector<KmerSpan>& profiles, uint firstProfile, uint lastProfile, float* scores) const
+{
+	const float* blockLogProb = &m_logProb[0];
+	for(uint p = firstProfile; p < lastProfile; ++p)
+		s_blockScoringKernel(blockLogProb, profiles[p], scores + (ulong)p * MODEL_BLOCK_WIDTH);
+}
+
+void ModelBlock::classify(const std::vector<KmerSpan>& profiles, uint numThreads, std::vector< std::vector<float> >& logLikelihoods) const
+{
+	std::vector<float> scores(profiles.size() * MODEL_BLOCK_WIDTH);
+
+	// each thread scores a contiguous range of profiles
+	numThreads = std::max(1U, std::min(numThreads, (uint)profiles.size()));
+	uint profilesPerThread = (profiles.size() + numThreads - 1) / numThreads;
+	std::vector< std::future<void> > threads;
+	for(uint t = 1; t < numThreads; ++t)
+	{
+		uint firstProfile = std::min((uint)profiles.size(), t * profilesPerThread);
+		uint lastProfile = std::min((uint)profiles.size(), firstProfile + profilesPerThread);
+		threads.push_back(std::async(std::launch::async, &ModelBlock::classifyRange, this, std::cref(profiles), firstProfile, lastProfile, &scores[0]));
+	}
+
+	if(!profiles.empty())
+		classifyRange(profiles, 0, std::min((uint)profiles.size(), profilesPerThread), &scores[0]);
+
+	for(uint t = 0; t < threads.size(); ++t)
+		threads[t].get();
+
+	logLikelihoods.resize(m_numModels);
+	for(uint m = 0; m < m_numModels; ++m)
+	{
+		logLikelihoods[m].resize(profiles.size());
+		for(uint p = 0; p < profiles.size(); ++p)
+			logLikelihoods[m][p] = scores[(ulong)p * MODEL_BLOCK_WIDTH + m];
+	}
+}
\ No newline at end of file
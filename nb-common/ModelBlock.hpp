@@ -0,0 +1,62 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef MODEL_BLOCK
+#define MODEL_BLOCK
+
+#include "stdafx.h"
+
+#include "KmerModel.hpp"
+#include "ScoringKernels.hpp"
+
+// Log probability tables of a block of up to MODEL_BLOCK_WIDTH models interleaved so the values 
+// of each k-mer are contiguous. Scoring a batch of profiles against the block is a sparse profile 
+// times dense model matrix product: each k-mer of a profile reads a single row of the block and
+// the log likelihoods of all models in the block are held in registers.
+class ModelBlock
+{
+public:
+	ModelBlock();
+
+	// interleave tables of models [firstModel, firstModel + numModels), unused columns are zero
+	void set(const std::vector<KmerModel*>& models, uint firstModel, uint numModels);
+
+	uint numModels() const { return m_numModels; }
+
+	// log likelihood of a profile under each model in the block, scores must hold MODEL_BLOCK_WIDTH values
+	void classify(const KmerSpan& profile, float* scores) const { s_blockScoringKernel(&m_logProb[0], profile, scores); }
+
+	// log likelihood of each profile under each model in the block, with profiles divided between threads
+	void classify(const std::vector<KmerSpan>& profiles, uint numThreads, std::vector< std::vector<float> >& logLikelihoods) const;
+
+	static void scoringKernel(SCORING_KERNEL kernel) { s_blockScoringKernel = ::blockScoringKernel(kernel); }
+
+private:
+	void classifyRange(const std::vector<KmerSpan>& profiles, uint firstProfile, uint lastProfile, float* scores) const;
+
+private:
+	static BlockScoringKernel s_blockScoringKernel;
+
+	std::vector<float> m_logProb;
+	uint m_numModels;
+};
+
+#endif
\ No newline at end of file
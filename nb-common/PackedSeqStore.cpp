@@ -0,0 +1,112 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "PackedSeqStore.hpp"
+
+PackedSeqStore::PackedSeqStore()
+{
+	// map nucleotides to 2-bit values
+	memset(m_baseValues, AMBIGUOUS_BASE, 256*sizeof(byte));
+
+	m_baseValues['a'] = m_baseValues['A'] = 0;
+	m_baseValues['c'] = m_baseValues['C'] = 1;
+	m_baseValues['g'] = m_baseValues['G'] = 2;
+	m_baseValues['t'] = m_baseValues['T'] = 3;
+	m_baseValues['u'] = m_baseValues['U'] = 3;
+
+	clear();
+}
+
+void PackedSeqStore::clear()
+{
+	// memory is retained so the store can be reused without reallocation
+	m_packedBases.clear();
+	m_numBases = 0;
+
+	m_ambiguousStart.clear();
+	m_ambiguousEnd.clear();
+}
+
+ulong PackedSeqStore::add(const char* seq, ulong length)
+{
+	ulong startPos = m_numBases;
+	ulong pos = startPos;
+	ulong endPos = pos + length;
+	m_packedBases.resize((endPos + BASES_PER_WORD - 1) / BASES_PER_WORD, 0);
+
+	bool bInAmbiguousRun = false;
+	for(ulong i = 0; i < length; ++i, ++pos)
+	{
+		byte value = m_baseValues[(byte)seq[i]];
+		if(value == AMBIGUOUS_BASE)
+		{
+			if(!bInAmbiguousRun)
+			{
+				m_ambiguousStart.push_back(pos);
+				m_ambiguousEnd.push_back(pos);
+				bInAmbiguousRun = true;
+			}
+
+			m_ambiguousEnd.back() = pos + 1;
+			continue;
+		}
+
+		bInAmbiguousRun = false;
+		m_packedBases[pos / BASES_PER_WORD] |= uint64(value) << (2*(pos % BASES_PER_WORD));
+	}
+
+	m_numBases = endPos;
+
+	return startPos;
+}
+
+uint PackedSeqStore::firstAmbiguousRun(ulong pos) const
+{
+	// index of first run ending after the given position
+	return std::upper_bound(m_ambiguousEnd.begin(), m_ambiguousEnd.end(), pos) - m_ambiguousEnd.begin();
+}
+
+ulong PackedSeqStore::gcCount(ulong start, ulong length, ulong& validBases) const
+{
+	ulong end = start + length;
+
+	// ambiguous bases are stored as A so only need to be removed from the number of valid bases
+	validBases = length;
+	for(uint run = firstAmbiguousRun(start); run < numAmbiguousRuns() && m_ambiguousStart[run] < end; ++run)
+		validBases -= std::min(m_ambiguousEnd[run], end) - std::max(m_ambiguousStart[run], start);
+
+	// C = 01 and G = 10 are the bases whose two bits differ
+	ulong gcBases = 0;
+	for(ulong pos = start; pos < end; ++pos)
+	{
+		byte value = base(pos);
+		gcBases += (value ^ (value >> 1)) & 1;
+	}
+
+	return gcBases;
+}
+
+ulong PackedSeqStore::memoryUsage() const
+{
+	return m_packedBases.size()*sizeof(uint64) + (m_ambiguousStart.size() + m_ambiguousEnd.size())*sizeof(ulong);
+}
\ No newline at end of file
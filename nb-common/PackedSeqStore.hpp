@@ -0,0 +1,69 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef PACKED_SEQ_STORE
+#define PACKED_SEQ_STORE
+
+#include "stdafx.h"
+
+class PackedSeqStore
+{
+public:
+	static const uint BASES_PER_WORD = 32;
+	static const byte AMBIGUOUS_BASE = 255;
+
+public:
+	PackedSeqStore();
+
+	void clear();
+
+	ulong add(const char* seq, ulong length);
+
+	ulong size() const { return m_numBases; }
+
+	const uint64* packedBases() const { return m_packedBases.empty() ? NULL : &m_packedBases[0]; }
+
+	// 2-bit value of base (A=0, C=1, G=2, T=3) with ambiguous bases stored as 0
+	byte base(ulong pos) const { return (m_packedBases[pos / BASES_PER_WORD] >> (2*(pos % BASES_PER_WORD))) & 3; }
+
+	uint numAmbiguousRuns() const { return m_ambiguousStart.size(); }
+	uint firstAmbiguousRun(ulong pos) const;
+	ulong ambiguousRunStart(uint run) const { return m_ambiguousStart[run]; }
+	ulong ambiguousRunEnd(uint run) const { return m_ambiguousEnd[run]; }
+
+	// number of G or C bases in [start, start + length), with the number of unambiguous bases
+	ulong gcCount(ulong start, ulong length, ulong& validBases) const;
+
+	ulong memoryUsage() const;
+
+private:
+	byte m_baseValues[256];
+
+	// bases of all sequences packed 32 per word, in the order they were added
+	std::vector<uint64> m_packedBases;
+	ulong m_numBases;
+
+	// runs [start, end) of ambiguous bases
+	std::vector<ulong> m_ambiguousStart;
+	std::vector<ulong> m_ambiguousEnd;
+};
+
+#endif
\ No newline at end of file
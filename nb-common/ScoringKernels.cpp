@@ -0,0 +1,425 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "ScoringKernels.hpp"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+	#define TARGET_ISA(isa)
+#else
+	#define TARGET_ISA(isa) __attribute__((target(isa)))
+#endif
+
+float scoreScalar(const float* logProb, const uint* kmers, ulong numKmers)
+{
+	float sum = 0.0f;
+	for(ulong i = 0; i < numKmers; ++i)
+		sum += logProb[kmers[i]];
+
+	return sum;
+}
+
+float scoreCounted(const float* logProb, const uint* kmers, const uint* counts, ulong numKmers)
+{
+	float sum = 0.0f;
+	for(ulong i = 0; i < numKmers; ++i)
+		sum += counts[i] * logProb[kmers[i]];
+
+	return sum;
+}
+
+float scoreSSE2(const float* logProb, const uint* kmers, ulong numKmers)
+{
+	// SSE2 lacks a gather instruction so table lookups are scalar with 8 independent accumulators
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+
+	ulong i = 0;
+	for(; i + 8 <= numKmers; i += 8)
+	{
+		sum0 = _mm_add_ps(sum0, _mm_set_ps(logProb[kmers[i+3]], logProb[kmers[i+2]], logProb[kmers[i+1]], logProb[kmers[i]]));
+		sum1 = _mm_add_ps(sum1, _mm_set_ps(logProb[kmers[i+7]], logProb[kmers[i+6]], logProb[kmers[i+5]], logProb[kmers[i+4]]));
+	}
+
+	float partialSums[4];
+	_mm_storeu_ps(partialSums, _mm_add_ps(sum0, sum1));
+
+	float sum = (partialSums[0] + partialSums[1]) + (partialSums[2] + partialSums[3]);
+	for(; i < numKmers; ++i)
+		sum += logProb[kmers[i]];
+
+	return sum;
+}
+
+TARGET_ISA("avx2")
+float scoreAVX2(const float* logProb, const uint* kmers, ulong numKmers)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+
+	ulong i = 0;
+	for(; i + 16 <= numKmers; i += 16)
+	{
+		__m256i index0 = _mm256_loadu_si256((const __m256i*)(kmers + i));
+		__m256i index1 = _mm256_loadu_si256((const __m256i*)(kmers + i + 8));
+		sum0 = _mm256_add_ps(sum0, _mm256_i32gather_ps(logProb, index0, 4));
+		sum1 = _mm256_add_ps(sum1, _mm256_i32gather_ps(logProb, index1, 4));
+	}
+
+	__m256 sum8 = _mm256_add_ps(sum0, sum1);
+	__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+
+	float partialSums[4];
+	_mm_storeu_ps(partialSums, sum4);
+
+	float sum = (partialSums[0] + partialSums[1]) + (partialSums[2] + partialSums[3]);
+	for(; i < numKmers; ++i)
+		sum += logProb[kmers[i]];
+
+	return sum;
+}
+
+TARGET_ISA("avx512f")
+float scoreAVX512(const float* logProb, const uint* kmers, ulong numKmers)
+{
+	__m512 sum0 = _mm512_setzero_ps();
+	__m512 sum1 = _mm512_setzero_ps();
+
+	ulong i = 0;
+	for(; i + 32 <= numKmers; i += 32)
+	{
+		__m512i index0 = _mm512_loadu_si512((const void*)(kmers + i));
+		__m512i index1 = _mm512_loadu_si512((const void*)(kmers + i + 16));
+		sum0 = _mm512_add_ps(sum0, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, index0, logProb, 4));
+		sum1 = _mm512_add_ps(sum1, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, index1, logProb, 4));
+	}
+
+	float partialSums[16];
+	_mm512_storeu_ps(partialSums, _mm512_add_ps(sum0, sum1));
+
+	float sum = 0.0f;
+	for(uint j = 0; j < 16; ++j)
+		sum += partialSums[j];
+
+	for(; i < numKmers; ++i)
+		sum += logProb[kmers[i]];
+
+	return sum;
+}
+
+// number of k-mers ahead of the current position to prefetch in each interleaved profile
+const ulong INTERLEAVE_PREFETCH_DISTANCE = 8;
+
+template<uint G> 
+static void scoreGroup(const float* logProb, const KmerSpan* profiles, float* scores)
+{
+	// interleave profiles over their common length with a register accumulator per profile
+	ulong minKmers = profiles[0].numKmers;
+	for(uint p = 1; p < G; ++p)
+		minKmers = std::min(minKmers, profiles[p].numKmers);
+
+	float sums[G];
+	for(uint p = 0; p < G; ++p)
+		sums[p] = 0.0f;
+
+	ulong i = 0;
+	for(; i + INTERLEAVE_PREFETCH_DISTANCE < minKmers; ++i)
+	{
+		for(uint p = 0; p < G; ++p)
+		{
+			_mm_prefetch((const char*)&logProb[profiles[p].kmers[i + INTERLEAVE_PREFETCH_DISTANCE]], _MM_HINT_T0);
+			sums[p] += logProb[profiles[p].kmers[i]];
+		}
+	}
+
+	// finish each profile in turn
+	for(uint p = 0; p < G; ++p)
+	{
+		for(ulong j = i; j < profiles[p].numKmers; ++j)
+			sums[p] += logProb[profiles[p].kmers[j]];
+
+		scores[p] = sums[p];
+	}
+}
+
+void scoreInterleaved(const float* logProb, const KmerSpan* profiles, uint numProfiles, uint groupSize, float* scores)
+{
+	uint p = 0;
+	if(groupSize >= 16)
+	{
+		for(; p + 16 <= numProfiles; p += 16)
+			scoreGroup<16>(logProb, profiles + p, scores + p);
+	}
+	else if(groupSize >= 8)
+	{
+		for(; p + 8 <= numProfiles; p += 8)
+			scoreGroup<8>(logProb, profiles + p, scores + p);
+	}
+	else if(groupSize >= 4)
+	{
+		for(; p + 4 <= numProfiles; p += 4)
+			scoreGroup<4>(logProb, profiles + p, scores + p);
+	}
+	else if(groupSize >= 2)
+	{
+		for(; p + 2 <= numProfiles; p += 2)
+			scoreGroup<2>(logProb, profiles + p, scores + p);
+	}
+
+	// remaining profiles are scored individually
+	for(; p < numProfiles; ++p)
+		scores[p] = scoreScalar(logProb, profiles[p].kmers, profiles[p].numKmers);
+}
+
+void scoreBlockScalar(const float* blockLogProb, const KmerSpan& profile, float* scores)
+{
+	float sums[MODEL_BLOCK_WIDTH];
+	for(uint m = 0; m < MODEL_BLOCK_WIDTH; ++m)
+		sums[m] = 0.0f;
+
+	for(ulong i = 0; i < profile.numKmers; ++i)
+	{
+		const float* row = blockLogProb + (ulong)profile.kmers[i] * MODEL_BLOCK_WIDTH;
+		if(profile.counts)
+		{
+			uint count = profile.counts[i];
+			for(uint m = 0; m < MODEL_BLOCK_WIDTH; ++m)
+				sums[m] += count * row[m];
+		}
+		else
+		{
+			for(uint m = 0; m < MODEL_BLOCK_WIDTH; ++m)
+				sums[m] += row[m];
+		}
+	}
+
+	for(uint m = 0; m < MODEL_BLOCK_WIDTH; ++m)
+		scores[m] = sums[m];
+}
+
+void scoreBlockSSE2(const float* blockLogProb, const KmerSpan& profile, float* scores)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	__m128 sum2 = _mm_setzero_ps();
+	__m128 sum3 = _mm_setzero_ps();
+
+	for(ulong i = 0; i < profile.numKmers; ++i)
+	{
+		const float* row = blockLogProb + (ulong)profile.kmers[i] * MODEL_BLOCK_WIDTH;
+		__m128 row0 = _mm_loadu_ps(row);
+		__m128 row1 = _mm_loadu_ps(row + 4);
+		__m128 row2 = _mm_loadu_ps(row + 8);
+		__m128 row3 = _mm_loadu_ps(row + 12);
+		if(profile.counts)
+		{
+			__m128 count = _mm_set1_ps((float)profile.counts[i]);
+			row0 = _mm_mul_ps(count, row0);
+			row1 = _mm_mul_ps(count, row1);
+			row2 = _mm_mul_ps(count, row2);
+			row3 = _mm_mul_ps(count, row3);
+		}
+
+		sum0 = _mm_add_ps(sum0, row0);
+		sum1 = _mm_add_ps(sum1, row1);
+		sum2 = _mm_add_ps(sum2, row2);
+		sum3 = _mm_add_ps(sum3, row3);
+	}
+
+	_mm_storeu_ps(scores, sum0);
+	_mm_storeu_ps(scores + 4, sum1);
+	_mm_storeu_ps(scores + 8, sum2);
+	_mm_storeu_ps(scores + 12, sum3);
+}
+
+TARGET_ISA("avx2")
+void scoreBlockAVX2(const float* blockLogProb, const KmerSpan& profile, float* scores)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+
+	for(ulong i = 0; i < profile.numKmers; ++i)
+	{
+		const float* row = blockLogProb + (ulong)profile.kmers[i] * MODEL_BLOCK_WIDTH;
+		__m256 row0 = _mm256_loadu_ps(row);
+		__m256 row1 = _mm256_loadu_ps(row + 8);
+		if(profile.counts)
+		{
+			__m256 count = _mm256_set1_ps((float)profile.counts[i]);
+			row0 = _mm256_mul_ps(count, row0);
+			row1 = _mm256_mul_ps(count, row1);
+		}
+
+		sum0 = _mm256_add_ps(sum0, row0);
+		sum1 = _mm256_add_ps(sum1, row1);
+	}
+
+	_mm256_storeu_ps(scores, sum0);
+	_mm256_storeu_ps(scores + 8, sum1);
+}
+
+TARGET_ISA("avx512f")
+void scoreBlockAVX512(const float* blockLogProb, const KmerSpan& profile, float* scores)
+{
+	__m512 sum = _mm512_setzero_ps();
+
+	for(ulong i = 0; i < profile.numKmers; ++i)
+	{
+		__m512 row = _mm512_loadu_ps(blockLogProb + (ulong)profile.kmers[i] * MODEL_BLOCK_WIDTH);
+		if(profile.counts)
+			row = _mm512_mul_ps(_mm512_set1_ps((float)profile.counts[i]), row);
+
+		sum = _mm512_add_ps(sum, row);
+	}
+
+	_mm512_storeu_ps(scores, sum);
+}
+
+#ifdef _MSC_VER
+static bool cpuSupports(SCORING_KERNEL kernel)
+{
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool bSSE2 = (info[3] & (1 << 26)) != 0;
+	bool bOSXSAVE = (info[2] & (1 << 27)) != 0;
+	if(kernel == SSE2_KERNEL)
+		return bSSE2;
+
+	if(!bOSXSAVE || maxLeaf < 7)
+		return false;
+
+	// check OS saves AVX (and AVX-512) register state
+	unsigned long long xcr0 = _xgetbv(0);
+
+	__cpuidex(info, 7, 0);
+	if(kernel == AVX2_KERNEL)
+		return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+	else if(kernel == AVX512_KERNEL)
+		return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0;
+
+	return false;
+}
+#else
+static bool cpuSupports(SCORING_KERNEL kernel)
+{
+	__builtin_cpu_init();
+
+	if(kernel == SSE2_KERNEL)
+		return __builtin_cpu_supports("sse2");
+	else if(kernel == AVX2_KERNEL)
+		return __builtin_cpu_supports("avx2");
+	else if(kernel == AVX512_KERNEL)
+		return __builtin_cpu_supports("avx512f");
+
+	return false;
+}
+#endif
+
+bool isScoringKernelSupported(SCORING_KERNEL kernel)
+{
+	if(kernel == AUTO_KERNEL || kernel == SCALAR_KERNEL)
+		return true;
+
+	return cpuSupports(kernel);
+}
+
+SCORING_KERNEL bestScoringKernel()
+{
+	if(cpuSupports(AVX512_KERNEL))
+		return AVX512_KERNEL;
+	else if(cpuSupports(AVX2_KERNEL))
+		return AVX2_KERNEL;
+	else if(cpuSupports(SSE2_KERNEL))
+		return SSE2_KERNEL;
+
+	return SCALAR_KERNEL;
+}
+
+ScoringKernel scoringKernel(SCORING_KERNEL kernel)
+{
+	if(kernel == AUTO_KERNEL)
+		kernel = bestScoringKernel();
+
+	if(kernel == SSE2_KERNEL)
+		return scoreSSE2;
+	else if(kernel == AVX2_KERNEL)
+		return scoreAVX2;
+	else if(kernel == AVX512_KERNEL)
+		return scoreAVX512;
+
+	return scoreScalar;
+}
+
+BlockScoringKernel blockScoringKernel(SCORING_KERNEL kernel)
+{
+	if(kernel == AUTO_KERNEL)
+		kernel = bestScoringKernel();
+
+	if(kernel == SSE2_KERNEL)
+		return scoreBlockSSE2;
+	else if(kernel == AVX2_KERNEL)
+		return scoreBlockAVX2;
+	else if(kernel == AVX512_KERNEL)
+		return scoreBlockAVX512;
+
+	return scoreBlockScalar;
+}
+
+bool parseScoringKernel(const std::string& name, SCORING_KERNEL& kernel)
+{
+	if(name == "auto")
+		kernel = AUTO_KERNEL;
+	else if(name == "scalar")
+		kernel = SCALAR_KERNEL;
+	else if(name == "sse2")
+		kernel = SSE2_KERNEL;
+	else if(name == "avx2")
+		kernel = AVX2_KERNEL;
+	else if(name == "avx512")
+		kernel = AVX512_KERNEL;
+	else
+		return false;
+
+	return true;
+}
+
+std::string scoringKernelName(SCORING_KERNEL kernel)
+{
+	if(kernel == AUTO_KERNEL)
+		kernel = bestScoringKernel();
+
+	if(kernel == SSE2_KERNEL)
+		return "sse2";
+	else if(kernel == AVX2_KERNEL)
+		return "avx2";
+	else if(kernel == AVX512_KERNEL)
+		return "avx512";
+
+	return "scalar";
+}
\ No newline at end of file
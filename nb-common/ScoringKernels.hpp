@@ -0,0 +1,71 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef SCORING_KERNELS
+#define SCORING_KERNELS
+
+#include "stdafx.h"
+
+// Kernels for summing the log probability of each k-mer in a profile. The SIMD kernels
+// use multiple independent accumulators so summation order differs from the scalar kernel.
+enum SCORING_KERNEL { AUTO_KERNEL, SCALAR_KERNEL, SSE2_KERNEL, AVX2_KERNEL, AVX512_KERNEL };
+
+typedef float (*ScoringKernel)(const float* logProb, const uint* kmers, ulong numKmers);
+
+float scoreScalar(const float* logProb, const uint* kmers, ulong numKmers);
+float scoreSSE2(const float* logProb, const uint* kmers, ulong numKmers);
+float scoreAVX2(const float* logProb, const uint* kmers, ulong numKmers);
+float scoreAVX512(const float* logProb, const uint* kmers, ulong numKmers);
+
+// Score a compacted profile where each distinct k-mer is weighted by its number of occurrences.
+float scoreCounted(const float* logProb, const uint* kmers, const uint* counts, ulong numKmers);
+
+// Score a batch of profiles by interleaving the k-mer streams of groupSize profiles so table 
+// lookups for many profiles are in flight at once. Each profile is summed in order so results
+// are identical to the scalar kernel.
+void scoreInterleaved(const float* logProb, const KmerSpan* profiles, uint numProfiles, uint groupSize, float* scores);
+
+// Number of models whose log probability tables are interleaved for blocked scoring.
+const uint MODEL_BLOCK_WIDTH = 16;
+
+// Add the log probability of each k-mer in a profile under a block of MODEL_BLOCK_WIDTH models whose
+// tables are interleaved so the values of a k-mer are contiguous. This is one row of a sparse profile
+// times dense model matrix product. The SIMD kernels vectorize across models and sum each model in
+// k-mer order so results are identical to the scalar kernel.
+typedef void (*BlockScoringKernel)(const float* blockLogProb, const KmerSpan& profile, float* scores);
+
+void scoreBlockScalar(const float* blockLogProb, const KmerSpan& profile, float* scores);
+void scoreBlockSSE2(const float* blockLogProb, const KmerSpan& profile, float* scores);
+void scoreBlockAVX2(const float* blockLogProb, const KmerSpan& profile, float* scores);
+void scoreBlockAVX512(const float* blockLogProb, const KmerSpan& profile, float* scores);
+
+// best kernel supported by the host CPU
+SCORING_KERNEL bestScoringKernel();
+
+bool isScoringKernelSupported(SCORING_KERNEL kernel);
+
+ScoringKernel scoringKernel(SCORING_KERNEL kernel);
+BlockScoringKernel blockScoringKernel(SCORING_KERNEL kernel);
+
+bool parseScoringKernel(const std::string& name, SCORING_KERNEL& kernel);
+std::string scoringKernelName(SCORING_KERNEL kernel);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include "SketchIndex.hpp"
+#include "Utils.hpp"
+
+SketchIndex::SketchIndex()
+	: m_kmerLength(0), m_scale(1), m_maxHash(0), m_kmerCalculator(NULL)
+{
+	set(DEFAULT_KMER_LENGTH, DEFAULT_SCALE);
+}
+
+SketchIndex::~SketchIndex()
+{
+	delete m_kmerCalculator;
+}
+
+void SketchIndex::clear()
+{
+	m_modelNames.clear();
+	m_sketchSizes.clear();
+
+	m_modelHashes.clear();
+	m_entries.clear();
+
+	m_hashes.clear();
+	m_offsets.assign(1, 0);
+	m_postings.clear();
+}
+
+void SketchIndex::set(uint kmerLength, uint scale)
+{
+	clear();
+
+	m_kmerLength = kmerLength;
+	m_scale = std::max(scale, 1U);
+	m_maxHash = ~uint64(0) / m_scale;
+
+	delete m_kmerCalculator;
+	m_kmerCalculator = new KmerCalculator(kmerLength);
+}
+
+uint SketchIndex::addModel(const std::string& name)
+{
+	flushModel();
+
+	m_modelNames.push_back(name);
+	m_sketchSizes.push_back(0);
+	return m_modelNames.size() - 1;
+}
+
+void SketchIndex::add(SeqInfo& seqInfo)
+{
+	// k-mers are extracted in pairs of a k-mer and its reverse complement
+	m_kmerBuffer.clear();
+	m_kmerCalculator->extractKmers(seqInfo, m_kmerBuffer);
+	for(ulong i = 0; i + 1 < m_kmerBuffer.size(); i += 2)
+	{
+		uint64 hash = mixHash(std::min(m_kmerBuffer[i], m_kmerBuffer[i+1]));
+		if(hash <= m_maxHash)
+			m_modelHashes.push_back(hash);
+	}
+}
+
+void SketchIndex::flushModel()
+{
+	std::sort(m_modelHashes.begin(), m_modelHashes.end());
+	std::vector<uint64>::iterator last = std::unique(m_modelHashes.begin(), m_modelHashes.end());
+	for(std::vector<uint64>::iterator it = m_modelHashes.begin(); it != last; ++it)
+		m_entries.push_back(std::make_pair(*it, (uint)m_modelNames.size() - 1));
+
+	if(!m_modelNames.empty())
+		m_sketchSizes.back() += last - m_modelHashes.begin();
+
+	m_modelHashes.clear();
+}
+
+void SketchIndex::build()
+{
+	flushModel();
+	std::vector<uint64>().swap(m_kmerBuffer);
+
+	// postings of each hash are in model order
+	std::sort(m_entries.begin(), m_entries.end());
+
+	m_hashes.clear();
+	m_offsets.assign(1, 0);
+	m_postings.clear();
+	m_postings.reserve(m_entries.size());
+	for(ulong i = 0; i < m_entries.size(); ++i)
+	{
+		if(m_hashes.empty() || m_entries[i].first != m_hashes.back())
+		{
+			m_hashes.push_back(m_entries[i].first);
+			m_offsets.push_back(m_offsets.back());
+		}
+
+		m_postings.push_back(m_entries[i].second);
+		m_offsets.back()++;
+	}
+
+	std::vector< std::pair<uint64, uint> >().swap(m_entries);
+}
+
+void SketchIndex::renumberModels(const std::vector<uint>& newIndices)
+{
+	std::vector<std::string> modelNames(m_modelNames.size());
+	std::vector<uint> sketchSizes(m_sketchSizes.size());
+	for(uint i = 0; i < m_modelNames.size(); ++i)
+	{
+		modelNames[newIndices[i]] = m_modelNames[i];
+		sketchSizes[newIndices[i]] = m_sketchSizes[i];
+	}
+	m_modelNames.swap(modelNames);
+	m_sketchSizes.swap(sketchSizes);
+
+	for(ulong p = 0; p < m_postings.size(); ++p)
+		m_postings[p] = newIndices[m_postings[p]];
+}
+
+void SketchIndex::sketch(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, std::vector<uint64>& hashes) const
+{
+	struct SketchVisitor
+	{
+		SketchVisitor(const KmerCalculator& _kmerCalculator, uint64 _maxHash, std::vector<uint64>& _hashes)
+			: kmerCalculator(_kmerCalculator), maxHash(_maxHash), hashes(_hashes) {}
+
+		void operator()(uint64 kmer)
+		{
+			uint64 hash = mixHash(std::min(kmer, kmerCalculator.reverseComplement(kmer)));
+			if(hash <= maxHash)
+				hashes.push_back(hash);
+		}
+
+		const KmerCalculator& kmerCalculator;
+		uint64 maxHash;
+		std::vector<uint64>& hashes;
+	};
+
+	hashes.clear();
+	SketchVisitor visitor(*m_kmerCalculator, m_maxHash, hashes);
+	m_kmerCalculator->visitForwardKmers(seqStore, seqOffset, seqLength, visitor);
+
+	std::sort(hashes.begin(), hashes.end());
+	hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+}
+
+void SketchIndex::countShared(const std::vector<uint64>& hashes, uint* sharedCounts) const
+{
+	// both sets of hashes are sorted, so each search starts from the position of the previous hash
+	std::vector<uint64>::const_iterator pos = m_hashes.begin();
+	for(ulong i = 0; i < hashes.size() && pos != m_hashes.end(); ++i)
+	{
+		pos = std::lower_bound(pos, m_hashes.end(), hashes[i]);
+		if(pos == m_hashes.end() || *pos != hashes[i])
+			continue;
+
+		ulong hashIndex = pos - m_hashes.begin();
+		for(uint64 p = m_offsets[hashIndex]; p < m_offsets[hashIndex + 1]; ++p)
+			sharedCounts[m_postings[p]]++;
+	}
+}
+
+void SketchIndex::write(const std::string& filename) const
+{
+	std::ofstream fout(filename.c_str(), std::ios::out | std::ios::binary);
+	if(!fout.is_open())
+	{
+		std::cout << "Failed to write sketches to file: " << filename << "." << std::endl;
+		return;
+	}
+
+	writeFileHeader(fout, "NBSK", FORMAT_VERSION);
+
+	fout.write((char*)&m_kmerLength, sizeof(uint));
+	fout.write((char*)&m_scale, sizeof(uint));
+
+	uint numModels = m_modelNames.size();
+	fout.write((char*)&numModels, sizeof(uint));
+	for(uint i = 0; i < numModels; ++i)
+		writeName(fout, m_modelNames[i]);
+	if(numModels > 0)
+		fout.write((char*)&m_sketchSizes[0], sizeof(uint)*numModels);
+
+	uint64 numHashes = m_hashes.size();
+	uint64 numPostings = m_postings.size();
+	fout.write((char*)&numHashes, sizeof(uint64));
+	fout.write((char*)&numPostings, sizeof(uint64));
+	if(numHashes > 0)
+	{
+		fout.write((char*)&m_hashes[0], sizeof(uint64)*numHashes);
+		fout.write((char*)&m_offsets[0], sizeof(uint64)*(numHashes + 1));
+		fout.write((char*)&m_postings[0], sizeof(uint)*numPostings);
+	}
+
+	fout.close();
+}
+
+bool SketchIndex::read(const std::string& filename)
+{
+	std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!fin.is_open())
+	{
+		std::cout << "Failed to read sketches from file: " << filename << "." << std::endl;
+		return false;
+	}
+
+	uint kmerLength, scale;
+	bool bValid = readFileHeader(fin, "NBSK", FORMAT_VERSION);
+	fin.read((char*)&kmerLength, sizeof(uint));
+	fin.read((char*)&scale, sizeof(uint));
+	if(!bValid || fin.fail() || kmerLength < 1 || kmerLength > KmerCalculator::MAX_KMER_LENGTH)
+	{
+		std::cout << "Invalid sketch file: " << filename << "." << std::endl;
+		return false;
+	}
+	set(kmerLength, scale);
+
+	// sizes are checked against the remainder of the file before anything is allocated
+	uint numModels;
+	fin.read((char*)&numModels, sizeof(uint));
+	bValid = !fin.fail() && numModels <= bytesRemaining(fin) / sizeof(size_t);
+	if(bValid)
+	{
+		m_modelNames.resize(numModels);
+		for(uint i = 0; i < numModels && bValid; ++i)
+			bValid = readName(fin, m_modelNames[i]);
+	}
+	bValid = bValid && readArray(fin, m_sketchSizes, numModels);
+
+	// each array is read with a single call
+	uint64 numHashes = 0, numPostings = 0;
+	fin.read((char*)&numHashes, sizeof(uint64));
+	fin.read((char*)&numPostings, sizeof(uint64));
+	bValid = bValid && !fin.fail();
+	if(bValid && numHashes > 0)
+	{
+		bValid = readArray(fin, m_hashes, numHashes);
+		bValid = bValid && readArray(fin, m_offsets, numHashes + 1);
+		bValid = bValid && readArray(fin, m_postings, numPostings);
+	}
+	else if(bValid)
+	{
+		m_offsets.assign(1, 0);
+		bValid = (numPostings == 0);
+	}
+
+	// offsets and model indices must stay within the arrays they refer to
+	for(uint64 i = 0; bValid && i < numHashes; ++i)
+		bValid = m_offsets[i] <= m_offsets[i + 1];
+	bValid = bValid && m_offsets[0] == 0 && m_offsets[numHashes] == numPostings;
+	for(uint64 i = 0; bValid && i < numPostings; ++i)
+		bValid = m_postings[i] < numModels;
+
+	if(!bValid)
+	{
+		std::cout << "Invalid sketch file: " << filename << "." << std::endl;
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+ulong SketchIndex::memoryUsage() const
+{
+	return m_hashes.capacity() * sizeof(uint64) + m_offsets.capacity() * sizeof(uint64) + m_postings.capacity() * sizeof(uint)
+					+ m_sketchSizes.capacity() * sizeof(uint);
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#ifndef SKETCH_INDEX
+#define SKETCH_INDEX
+
+#include "stdafx.h"
+
+#include "KmerCalculator.hpp"
+
+// FracMinHash sketches of a set of models. The sketch of a sequence holds the hashes of its canonical 
+// k-mers that fall below 1/scale of the range of hash values, so sketches are a uniform sample of about 
+// 1 in scale k-mers and the sketches of a query and a model can be compared directly. The fraction of 
+// the hashes of a query sketch found in a model sketch estimates the containment of the query k-mers in 
+// the model. Sketches of all models are stored as an inverted index from each hash to the models 
+// whose sketch contains it.
+class SketchIndex
+{
+public:
+	static const uint DEFAULT_KMER_LENGTH = 21;
+	static const uint DEFAULT_SCALE = 200;
+
+	// files start with the magic number "NBSK" and this version
+	static const uint FORMAT_VERSION = 1;
+
+public:
+	SketchIndex();
+	~SketchIndex();
+
+	void clear();
+
+	void set(uint kmerLength, uint scale);
+
+	uint kmerLength() const { return m_kmerLength; }
+	uint scale() const { return m_scale; }
+
+	// start adding sequences of a new model, returning the index of the model
+	uint addModel(const std::string& name);
+
+	// add hashes of a sequence to the sketch of the most recently added model
+	void add(SeqInfo& seqInfo);
+
+	// build inverted index once all models have been added
+	void build();
+
+	bool read(const std::string& filename);
+	void write(const std::string& filename) const;
+
+	// renumber models so model i becomes model newIndices[i], such as to follow the order of a model file
+	void renumberModels(const std::vector<uint>& newIndices);
+
+	uint numModels() const { return m_modelNames.size(); }
+	const std::string& name(uint modelIndex) const { return m_modelNames[modelIndex]; }
+	uint sketchSize(uint modelIndex) const { return m_sketchSizes[modelIndex]; }
+
+	ulong numHashes() const { return m_hashes.size(); }
+
+	// sorted, distinct hashes in the sketch of a packed sequence
+	void sketch(const PackedSeqStore& seqStore, ulong seqOffset, ulong seqLength, std::vector<uint64>& hashes) const;
+
+	// add the number of hashes of a sketch found in the sketch of each model to sharedCounts
+	void countShared(const std::vector<uint64>& hashes, uint* sharedCounts) const;
+
+	ulong memoryUsage() const;
+
+private:
+	void flushModel();
+
+private:
+	uint m_kmerLength;
+	uint m_scale;
+	uint64 m_maxHash;
+	KmerCalculator* m_kmerCalculator;
+
+	std::vector<std::string> m_modelNames;
+	std::vector<uint> m_sketchSizes;
+
+	// hashes of the current model and (hash, model) pairs of all previous models prior to the index being built
+	std::vector<uint64> m_modelHashes;
+	std::vector< std::pair<uint64, uint> > m_entries;
+	std::vector<uint64> m_kmerBuffer;
+
+	// models whose sketch contains hash m_hashes[i] are in [m_offsets[i], m_offsets[i+1])
+	std::vector<uint64> m_hashes;
+	std::vector<uint64> m_offsets;
+	std::vector<uint> m_postings;
+};
+
+#endif
\ No newline at end of file
@@ -45,4 +45,54 @@ std::string numberToStr(float number)
 	out << number;
 	
 	return out.str();
+}
+
+void writeFileHeader(std::ostream& out, const char* magic, uint version)
+{
+	out.write(magic, 4);
+	out.write((char*)&version, sizeof(uint));
+}
+
+bool readFileHeader(std::istream& in, const char* magic, uint version)
+{
+	char fileMagic[4];
+	uint fileVersion;
+	in.read(fileMagic, 4);
+	in.read((char*)&fileVersion, sizeof(uint));
+
+	return !in.fail() && memcmp(fileMagic, magic, 4) == 0 && fileVersion == version;
+}
+
+uint64 bytesRemaining(std::istream& in)
+{
+	std::streamoff pos = in.tellg();
+	in.seekg(0, std::ios::end);
+	std::streamoff end = in.tellg();
+	in.seekg(pos, std::ios::beg);
+
+	if(pos < 0 || end < pos)
+		return 0;
+
+	return (uint64)(end - pos);
+}
+
+void writeName(std::ostream& out, const std::string& name)
+{
+	size_t size = name.size();
+	out.write((char*)&size, sizeof(size_t));
+	out.write(name.c_str(), size);
+}
+
+bool readName(std::istream& in, std::string& name)
+{
+	size_t size;
+	in.read((char*)&size, sizeof(size_t));
+	if(in.fail() || size >= MAX_NAME_LENGTH || size > bytesRemaining(in))
+		return false;
+
+	char buffer[MAX_NAME_LENGTH];
+	in.read(buffer, size);
+	name.assign(buffer, size);
+
+	return !in.fail();
 }
\ No newline at end of file
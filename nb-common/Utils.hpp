@@ -28,4 +28,42 @@ std::string numberToStr(int number);
 std::string numberToStr(uint number);
 std::string numberToStr(float number);
 
+// binary files written by the tools start with a 4 character magic number and a format version
+void writeFileHeader(std::ostream& out, const char* magic, uint version);
+bool readFileHeader(std::istream& in, const char* magic, uint version);
+
+// bytes from the current position of a stream to the end of the file
+uint64 bytesRemaining(std::istream& in);
+
+// names are stored as their size_t length followed by their characters
+static const ulong MAX_NAME_LENGTH = 1024;
+void writeName(std::ostream& out, const std::string& name);
+bool readName(std::istream& in, std::string& name);
+
+// reads an array of the given number of values, failing without allocating if the file is too short
+template<typename T> bool readArray(std::istream& in, std::vector<T>& values, uint64 count)
+{
+	if(count > bytesRemaining(in) / sizeof(T))
+		return false;
+
+	values.resize(count);
+	if(count > 0)
+		in.read((char*)&values[0], sizeof(T)*count);
+
+	return !in.fail();
+}
+
+// mixes the bits of a value so that similar values (e.g., k-mers differing in a single base) have unrelated hashes
+inline uint64 mixHash(uint64 value)
+{
+	// finalizer of MurmurHash3
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDULL;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ULL;
+	value ^= value >> 33;
+
+	return value;
+}
+
 #endif
\ No newline at end of file
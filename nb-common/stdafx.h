@@ -48,5 +48,6 @@
 #include <cmath>
 #include <cfloat>
 #include <sstream>
+#include <future>
 
 #include "DataTypes.hpp"
\ No newline at end of file
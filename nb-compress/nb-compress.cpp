@@ -0,0 +1,561 @@
+//=======================================================================
+// Author: Donovan Parks
+//
+// Copyright 2010 Donovan Parks
+//
+// This file is part of NaiveBayes.
+//
+// NaiveBayes is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// NaiveBayes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with NaiveBayes.  If not, see <http://www.gnu.org/licenses/>.
+//=======================================================================
+
+#include "stdafx.h"
+
+#include <random>
+
+#include "KmerModel.hpp"
+#include "LowRankModel.hpp"
+#include "Utils.hpp"
+
+struct Parameters
+{
+	bool bShowHelp, bShowVersion, bShowContactInfo;
+	std::string modelFile, outputFile;
+	int rank, oversampling, powerIterations, verbose;
+};
+
+void help()
+{
+	std::cout << "Naive Bayes Compress v1.0.7" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Usage: [options] -m <model-file> -o <output-file>" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Required parameters:" << std::endl;
+	std::cout << "  <model-file>   File indicating models to compress." << std::endl;
+	std::cout << "  <output-file>  Output file for low-rank approximation of models." << std::endl;
+	std::cout << std::endl;
+	std::cout << "Optional parameters:" << std::endl;
+	std::cout << "  --help        Print help message." << std::endl;
+	std::cout << "  --version     Print version information." << std::endl;
+	std::cout << "  --contact     Print contact information." << std::endl;
+	std::cout << "  -r <integer>  Number of basis tables used to approximate models (default = 32)." << std::endl;
+	std::cout << "  -p <integer>  Additional basis tables estimated to improve accuracy (default = 8)." << std::endl;
+	std::cout << "  -i <integer>  Number of power iterations (default = 2)." << std::endl;
+	std::cout << "  -v <integer>  Level of output information (default = 1)." << std::endl;
+	std::cout << std::endl;
+	std::cout << "Typical usage:" << std::endl;
+	std::cout << "  nb-compress -m models.txt -o models_r32.bin" << std::endl;
+	std::cout << "  nb-classify -q test.fasta -m models.txt -l models_r32.bin -r nb_results.txt" << std::endl << std::endl;
+}
+
+// true if the option at position p is followed by a value
+bool hasValue(int argc, char* argv[], int p)
+{
+	if(p + 1 < argc)
+		return true;
+
+	std::cout << "Missing value for parameter: " << argv[p] << std::endl << std::endl;
+	return false;
+}
+
+bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
+{
+	// set default values
+	parameters.bShowHelp = false;
+	parameters.bShowContactInfo = false;
+	parameters.bShowVersion = false;
+	parameters.rank = 32;
+	parameters.oversampling = 8;
+	parameters.powerIterations = 2;
+	parameters.verbose = 1;
+
+	// parse parameters
+	int p = 1;
+	while(p < argc)
+	{
+		if(strcmp(argv[p], "-m") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.modelFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-o") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.outputFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-r") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.rank = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-p") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.oversampling = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-i") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.powerIterations = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "-v") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.verbose = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--help") == 0)
+		{
+			parameters.bShowHelp = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--version") == 0)
+		{
+			parameters.bShowVersion = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "--contact") == 0)
+		{
+			parameters.bShowContactInfo = true;
+			p += 1;
+		}
+		else
+		{
+			std::cout << "Unrecognized parameter: " << argv[p] << std::endl << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Applies an operation to the centred log probability table of each model in turn. Models are 
+// read from disk for every pass so memory requirements do not grow with the number of models.
+class ModelPass
+{
+public:
+	ModelPass(const std::vector<std::string>& modelFiles, const std::vector<float>& mean): m_modelFiles(modelFiles), m_mean(mean), m_centred(mean.size()) {}
+
+	// false if a model could not be read or no longer matches the table size of the first pass
+	template<class ModelVisitor>
+	bool apply(ModelVisitor& visitor)
+	{
+		for(uint m = 0; m < m_modelFiles.size(); ++m)
+		{
+			KmerModel kmerModel(m_modelFiles[m]);
+			if(!kmerModel.valid())
+				return false;
+			else if(kmerModel.sparse() || kmerModel.delta() || kmerModel.tableSize() != m_centred.size())
+			{
+				std::cout << "Model " << m_modelFiles[m] << " changed while being compressed." << std::endl;
+				return false;
+			}
+
+			const float* logProb = kmerModel.logConditionalProb();
+			for(ulong i = 0; i < m_centred.size(); ++i)
+				m_centred[i] = logProb[i] - m_mean[i];
+
+			visitor(m, m_centred);
+		}
+
+		return true;
+	}
+
+private:
+	const std::vector<std::string>& m_modelFiles;
+	const std::vector<float>& m_mean;
+	std::vector<float> m_centred;
+};
+
+// columns of the sample matrix are held as separate tables of the same length as a model
+typedef std::vector< std::vector<float> > ColumnMatrix;
+
+// Y += x * w^T for the weights of each model
+struct RangeVisitor
+{
+	RangeVisitor(ColumnMatrix& _range, const std::vector< std::vector<float> >& _weights): range(_range), weights(_weights) {}
+
+	void operator()(uint modelIndex, const std::vector<float>& centred)
+	{
+		for(uint j = 0; j < range.size(); ++j)
+		{
+			float w = weights[modelIndex][j];
+			float* column = &range[j][0];
+			for(ulong i = 0; i < centred.size(); ++i)
+				column[i] += w * centred[i];
+		}
+	}
+
+	ColumnMatrix& range;
+	const std::vector< std::vector<float> >& weights;
+};
+
+// z = Q^T x for each model, optionally accumulating Y += x * z^T for a power iteration
+struct ProjectionVisitor
+{
+	ProjectionVisitor(const ColumnMatrix& _basis, ColumnMatrix* _range): basis(_basis), range(_range), totalVariance(0) {}
+
+	void operator()(uint modelIndex, const std::vector<float>& centred)
+	{
+		std::vector<float> z(basis.size());
+		for(uint j = 0; j < basis.size(); ++j)
+		{
+			double sum = 0;
+			const float* column = &basis[j][0];
+			for(ulong i = 0; i < centred.size(); ++i)
+				sum += column[i] * centred[i];
+			z[j] = (float)sum;
+		}
+		projections.push_back(z);
+
+		double variance = 0;
+		for(ulong i = 0; i < centred.size(); ++i)
+			variance += (double)centred[i] * centred[i];
+		totalVariance += variance;
+
+		if(range != NULL)
+		{
+			RangeVisitor rangeVisitor(*range, projections);
+			rangeVisitor(modelIndex, centred);
+		}
+	}
+
+	const ColumnMatrix& basis;
+	ColumnMatrix* range;
+
+	std::vector< std::vector<float> > projections;
+	double totalVariance;
+};
+
+// orthonormalize columns with modified Gram-Schmidt, zeroing columns that are linearly dependent
+void orthonormalize(ColumnMatrix& columns)
+{
+	for(uint j = 0; j < columns.size(); ++j)
+	{
+		float* column = &columns[j][0];
+		ulong size = columns[j].size();
+
+		double originalNorm = 0;
+		for(ulong i = 0; i < size; ++i)
+			originalNorm += (double)column[i] * column[i];
+
+		for(uint k = 0; k < j; ++k)
+		{
+			const float* previous = &columns[k][0];
+			double dot = 0;
+			for(ulong i = 0; i < size; ++i)
+				dot += (double)previous[i] * column[i];
+			for(ulong i = 0; i < size; ++i)
+				column[i] -= (float)dot * previous[i];
+		}
+
+		double norm = 0;
+		for(ulong i = 0; i < size; ++i)
+			norm += (double)column[i] * column[i];
+
+		float scale = (norm > 1e-10 * originalNorm && norm > 0) ? (float)(1.0 / sqrt(norm)) : 0.0f;
+		for(ulong i = 0; i < size; ++i)
+			column[i] *= scale;
+	}
+}
+
+// eigenvalues and eigenvectors (columns of eigenvectors) of a small symmetric matrix by cyclic Jacobi rotations
+void symmetricEigen(std::vector< std::vector<double> > a, std::vector<double>& eigenvalues, std::vector< std::vector<double> >& eigenvectors)
+{
+	uint n = a.size();
+	eigenvectors.assign(n, std::vector<double>(n, 0.0));
+	for(uint i = 0; i < n; ++i)
+		eigenvectors[i][i] = 1.0;
+
+	for(uint sweep = 0; sweep < 100; ++sweep)
+	{
+		double offDiagonal = 0;
+		for(uint p = 0; p < n; ++p)
+			for(uint q = p + 1; q < n; ++q)
+				offDiagonal += a[p][q] * a[p][q];
+
+		if(offDiagonal < 1e-22)
+			break;
+
+		for(uint p = 0; p < n; ++p)
+		{
+			for(uint q = p + 1; q < n; ++q)
+			{
+				if(fabs(a[p][q]) < 1e-300)
+					continue;
+
+				double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1));
+				double c = 1.0 / sqrt(t*t + 1);
+				double s = t*c;
+
+				for(uint k = 0; k < n; ++k)
+				{
+					double akp = a[k][p];
+					double akq = a[k][q];
+					a[k][p] = c*akp - s*akq;
+					a[k][q] = s*akp + c*akq;
+				}
+
+				for(uint k = 0; k < n; ++k)
+				{
+					double apk = a[p][k];
+					double aqk = a[q][k];
+					a[p][k] = c*apk - s*aqk;
+					a[q][k] = s*apk + c*aqk;
+				}
+
+				for(uint k = 0; k < n; ++k)
+				{
+					double vkp = eigenvectors[k][p];
+					double vkq = eigenvectors[k][q];
+					eigenvectors[k][p] = c*vkp - s*vkq;
+					eigenvectors[k][q] = s*vkp + c*vkq;
+				}
+			}
+		}
+	}
+
+	eigenvalues.resize(n);
+	for(uint i = 0; i < n; ++i)
+		eigenvalues[i] = a[i][i];
+}
+
+int main(int argc, char* argv[])
+{
+	// Parse command-line arguments
+	Parameters parameters;
+	bool bParsed = parseCommandLine(argc, argv, parameters);
+
+	if(!bParsed || parameters.bShowHelp || argc == 1) 
+	{			
+		help();	
+		return 0;
+	}
+	else if(parameters.bShowVersion)
+	{
+		std::cout << "Naive Bayes Compress v1.0.7 by Donovan Parks, Norm MacDonald, and Rob Beiko." << std::endl;
+		return 0;
+	}
+	else if(parameters.bShowContactInfo)
+	{
+		std::cout << "Comments, suggestions, and bug reports can be sent to Donovan Parks (donovan.parks@gmail.com)." << std::endl;
+		return 0;
+	}
+	else if(parameters.modelFile.empty() || parameters.outputFile.empty())
+	{
+		std::cout << "Must specify model file (-m) and output file (-o)." << std::endl << std::endl;
+		help();
+		return 0;
+	}
+	else if(parameters.rank < 1 || parameters.oversampling < 0 || parameters.powerIterations < 0)
+	{
+		std::cout << "Rank must be positive, and oversampling and power iterations can not be negative." << std::endl;
+		return -1;
+	}
+
+	// read list of models and determine their n-mer length and format
+	std::vector<std::string> modelFiles;
+	std::ifstream modelStream(parameters.modelFile.c_str(), std::ios::in);
+	if(modelStream.fail())
+	{
+		std::cout << "Failed to open model file: " << parameters.modelFile << std::endl;
+		return -1;
+	}
+
+	while(true)
+	{
+		std::string line;
+		std::getline(modelStream, line);
+		if(line.empty())
+			break;
+		modelFiles.push_back(line);
+	}
+
+	if(modelFiles.size() < 2)
+	{
+		std::cout << "At least 2 models are required." << std::endl;
+		return -1;
+	}
+
+	// mean table over all models
+	if(parameters.verbose >= 1)
+		std::cout << "Calculating mean of " << modelFiles.size() << " models..." << std::endl;
+
+	uint kmerLength = 0;
+	bool bCanonical = false;
+	std::vector<std::string> modelNames;
+	std::vector<double> meanSum;
+	for(uint m = 0; m < modelFiles.size(); ++m)
+	{
+		KmerModel kmerModel(modelFiles[m]);
+		if(!kmerModel.valid())
+			return -1;
+
+		if(m == 0)
+		{
+			kmerLength = kmerModel.kmerLength();
+			bCanonical = kmerModel.canonical();
+			meanSum.assign(kmerModel.tableSize(), 0.0);
+		}
+
+		if(kmerModel.sparse() || kmerModel.delta())
+		{
+			std::cout << "Only dense and canonical models can be compressed: " << modelFiles[m] << std::endl;
+			return -1;
+		}
+		else if(kmerModel.kmerLength() != kmerLength || kmerModel.canonical() != bCanonical)
+		{
+			std::cout << "Model " << modelFiles[m] << " must have the same n-mer length and format as the first model." << std::endl;
+			return -1;
+		}
+
+		const float* logProb = kmerModel.logConditionalProb();
+		for(ulong i = 0; i < meanSum.size(); ++i)
+			meanSum[i] += logProb[i];
+
+		modelNames.push_back(kmerModel.name());
+	}
+
+	uint numModels = modelFiles.size();
+	ulong tableSize = meanSum.size();
+	std::vector<float> mean(tableSize);
+	for(ulong i = 0; i < tableSize; ++i)
+		mean[i] = (float)(meanSum[i] / numModels);
+	std::vector<double>().swap(meanSum);
+
+	// the centred tables span at most numModels - 1 dimensions
+	uint rank = std::min((uint)parameters.rank, numModels - 1);
+	uint numSamples = std::min(rank + parameters.oversampling, numModels - 1);
+
+	// randomized range finder: sample the range of the centred tables with Gaussian weights
+	if(parameters.verbose >= 1)
+		std::cout << "Sampling range of models with " << numSamples << " random projections..." << std::endl;
+
+	ModelPass modelPass(modelFiles, mean);
+
+	std::mt19937 generator(12345);
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	std::vector< std::vector<float> > weights(numModels, std::vector<float>(numSamples));
+	for(uint m = 0; m < numModels; ++m)
+		for(uint j = 0; j < numSamples; ++j)
+			weights[m][j] = normal(generator);
+
+	ColumnMatrix range(numSamples, std::vector<float>(tableSize, 0.0f));
+	RangeVisitor rangeVisitor(range, weights);
+	if(!modelPass.apply(rangeVisitor))
+		return -1;
+
+	for(int iter = 0; iter < parameters.powerIterations; ++iter)
+	{
+		if(parameters.verbose >= 1)
+			std::cout << "Power iteration " << (iter+1) << "..." << std::endl;
+
+		orthonormalize(range);
+
+		ColumnMatrix nextRange(numSamples, std::vector<float>(tableSize, 0.0f));
+		ProjectionVisitor projectionVisitor(range, &nextRange);
+		if(!modelPass.apply(projectionVisitor))
+			return -1;
+		range.swap(nextRange);
+	}
+	orthonormalize(range);
+
+	// project models onto the sampled range and find principal directions within it
+	if(parameters.verbose >= 1)
+		std::cout << "Projecting models onto basis..." << std::endl;
+
+	ProjectionVisitor projectionVisitor(range, NULL);
+	if(!modelPass.apply(projectionVisitor))
+		return -1;
+	const std::vector< std::vector<float> >& projections = projectionVisitor.projections;
+
+	std::vector< std::vector<double> > gram(numSamples, std::vector<double>(numSamples, 0.0));
+	for(uint m = 0; m < numModels; ++m)
+		for(uint j = 0; j < numSamples; ++j)
+			for(uint k = 0; k < numSamples; ++k)
+				gram[j][k] += (double)projections[m][j] * projections[m][k];
+
+	std::vector<double> eigenvalues;
+	std::vector< std::vector<double> > eigenvectors;
+	symmetricEigen(gram, eigenvalues, eigenvectors);
+
+	std::vector<uint> order(numSamples);
+	for(uint j = 0; j < numSamples; ++j)
+		order[j] = j;
+	std::sort(order.begin(), order.end(), [&eigenvalues](uint a, uint b) { return eigenvalues[a] > eigenvalues[b]; });
+
+	double explainedVariance = 0;
+	for(uint j = 0; j < rank; ++j)
+		explainedVariance += std::max(eigenvalues[order[j]], 0.0);
+
+	// basis tables are rotated into principal directions, with the mean as the first column
+	uint width = rank + 1;
+	std::vector<float> basis(tableSize * width);
+	for(ulong i = 0; i < tableSize; ++i)
+	{
+		basis[i*width] = mean[i];
+		for(uint j = 0; j < rank; ++j)
+		{
+			double sum = 0;
+			for(uint k = 0; k < numSamples; ++k)
+				sum += range[k][i] * eigenvectors[k][order[j]];
+			basis[i*width + j + 1] = (float)sum;
+		}
+	}
+
+	std::vector<float> coefficients((ulong)numModels * width);
+	for(uint m = 0; m < numModels; ++m)
+	{
+		coefficients[(ulong)m*width] = 1.0f;
+		for(uint j = 0; j < rank; ++j)
+		{
+			double sum = 0;
+			for(uint k = 0; k < numSamples; ++k)
+				sum += projections[m][k] * eigenvectors[k][order[j]];
+			coefficients[(ulong)m*width + j + 1] = (float)sum;
+		}
+	}
+
+	LowRankModel lowRankModel;
+	lowRankModel.set(kmerLength, bCanonical, rank, basis, coefficients, modelNames);
+	lowRankModel.write(parameters.outputFile);
+
+	if(parameters.verbose >= 1)
+	{
+		std::cout << std::endl;
+		std::cout << "Number of models: " << numModels << std::endl;
+		std::cout << "Rank: " << rank << std::endl;
+		std::cout << "Variance explained: " << (100.0 * explainedVariance / std::max(projectionVisitor.totalVariance, DBL_MIN)) << "%" << std::endl;
+		std::cout << "Low-rank model: " << lowRankModel.memoryUsage() << " bytes" << std::endl;
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -27,7 +27,7 @@
 
 struct Parameters
 {
-	bool bShowHelp, bShowVersion, bShowContactInfo;
+	bool bShowHelp, bShowVersion, bShowContactInfo, bCanonical, bSparse;
 	std::string inputFile, outputFile;
 	int kmerSize;
 };
@@ -45,6 +45,10 @@ void help()
 	std::cout << "  --version     Print version information." << std::endl;
 	std::cout << "  --contact     Print contact information." << std::endl;
 	std::cout << "  -n <integer>  Desired oligonucleotide length (default = 8)." << std::endl;
+	std::cout << "  -c            Store only canonical (strand-independent) n-mers. Reduces model size" << std::endl;
+	std::cout << "                  by 1/2 for odd n-mer lengths and 3/8 for even n-mer lengths." << std::endl;
+	std::cout << "  -p            Store only n-mers observed in the training sequences (sparse model). Always" << std::endl;
+	std::cout << "                  used for n-mer lengths above 13. Supports n-mer lengths up to 31." << std::endl;
 	std::cout << std::endl;
 	std::cout << "Typical usage:" << std::endl;
 	std::cout << "  nb-null-model -s sequences.fna -m null_model.txt"  << std::endl << std::endl;
@@ -57,6 +61,8 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 	parameters.bShowContactInfo = false;
 	parameters.bShowVersion = false;
 	parameters.kmerSize = 8;
+	parameters.bCanonical = false;
+	parameters.bSparse = false;
 
 	// parse parameters
 	int p = 1;
@@ -67,6 +73,16 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 			parameters.kmerSize = atoi(argv[p+1]);
 			p += 2;
 		}
+		else if(strcmp(argv[p], "-c") == 0)
+		{
+			parameters.bCanonical = true;
+			p += 1;
+		}
+		else if(strcmp(argv[p], "-p") == 0)
+		{
+			parameters.bSparse = true;
+			p += 1;
+		}
 		else if(strcmp(argv[p], "-i") == 0)
 		{
 			parameters.inputFile = argv[p+1];
@@ -129,11 +145,25 @@ int main(int argc, char* argv[])
 		help();
 		return 0;
 	}
+	else if(parameters.kmerSize < 1 || parameters.kmerSize > (int)KmerCalculator::MAX_KMER_LENGTH)
+	{
+		std::cout << "[Error] N-mer length must be between 1 and " << KmerCalculator::MAX_KMER_LENGTH << "." << std::endl;
+		return -1;
+	}
+	else if(parameters.bCanonical && (parameters.bSparse || parameters.kmerSize > (int)KmerModel::MAX_DENSE_KMER_LENGTH))
+	{
+		std::cout << "[Error] Canonical n-mers are not supported by sparse models." << std::endl;
+		return -1;
+	}
+
+	KmerModel::MODEL_FORMAT modelFormat = KmerModel::DENSE_MODEL;
+	if(parameters.bSparse || parameters.kmerSize > (int)KmerModel::MAX_DENSE_KMER_LENGTH)
+		modelFormat = KmerModel::SPARSE_MODEL;
 
 	// train null model
 	std::cout << "Building null model..." << std::endl;
 
-	KmerModel kmerModel(parameters.kmerSize);
+	KmerModel kmerModel(parameters.kmerSize, modelFormat);
 	kmerModel.name("Null Model");	
 
 	FastaIO fastaIO;
@@ -148,9 +178,18 @@ int main(int argc, char* argv[])
 	{
 		SeqInfo seqInfo;
 		bool bNextSeq = fastaIO.nextSeq(seqInfo);
+		if(!bNextSeq && fastaIO.error())
+		{
+			std::cerr << "[Error] Failed to read file: " << parameters.inputFile << std::endl;
+			return -1;
+		}
+
 		if(!bNextSeq)
 			break;
 
+		// all sequences belong to the null model, otherwise n-mer totals are reset for each sequence
+		seqInfo.taxonomy.strain = "Null Model";
+
 		bool bOK = kmerModel.constructModel(seqInfo);
 		if(!bOK)
 		{
@@ -160,6 +199,12 @@ int main(int argc, char* argv[])
 	}	
 
 	kmerModel.calculateConditionalProbabilities();
+	if(parameters.bCanonical && !kmerModel.makeCanonical())
+	{
+		std::cerr << "[Error] Canonical n-mers are not supported for this encoding." << std::endl;
+		return -1;
+	}
+
 	kmerModel.write(parameters.outputFile);
 
 	return 0;
@@ -21,15 +21,18 @@
 
 #include "stdafx.h"
 
+#include "ExactKmerIndex.hpp"
 #include "FastaIO.hpp"
 #include "KmerModel.hpp"
+#include "SketchIndex.hpp"
 #include "Utils.hpp"
 
 struct Parameters
 {
-	bool bShowHelp, bShowVersion, bShowContactInfo;
-	std::string sequenceFile, outputDir;
-	int kmerSize;
+	bool bShowHelp, bShowVersion, bShowContactInfo, bCanonical, bSparse;
+	std::string sequenceFile, outputDir, nullModelFile, exactIndexFile, sketchFile;
+	int kmerSize, prefilterKmerSize, gcWindowLength, exactKmerSize, sketchScale;
+	float deltaThreshold;
 };
 
 void help()
@@ -47,11 +50,50 @@ void help()
 	std::cout << "  --version     Print version information." << std::endl;
 	std::cout << "  --contact     Print contact information." << std::endl;
 	std::cout << "  -n <integer>  Desired oligonucleotide length (default = 8)." << std::endl;
+	std::cout << "  -c, --canonical     Store only canonical (strand-independent) n-mers. Reduces model" << std::endl;
+	std::cout << "                  size by 1/2 for odd n-mer lengths and 3/8 for even n-mer lengths." << std::endl;
+	std::cout << "  -p, --sparse        Store only n-mers observed in the training sequences (sparse model)." << std::endl;
+	std::cout << "                  Always used for n-mer lengths above 13. Supports n-mer lengths up to 31." << std::endl;
+	std::cout << "  -d, --null-model <file>  Store only n-mers whose log probability differs from the given null" << std::endl;
+	std::cout << "                  model (see nb-null-model) by more than the threshold set with -x (delta" << std::endl;
+	std::cout << "                  model). Delta models are classified with nb-classify --null-model <file>" << std::endl;
+	std::cout << "                  using the same null model and give approximate log likelihoods." << std::endl;
+	std::cout << "  -x, --delta-threshold <float>  Threshold for delta models (default = 1.0)." << std::endl;
+	std::cout << "  -f, --prefilter-length <integer>  Also build a dense prefilter model with the given n-mer" << std::endl;
+	std::cout << "                  length for each sequence file, written as <model-name>.prefilter so listing" << std::endl;
+	std::cout << "                  the models with *.txt does not include them (see nb-classify --prefilter)." << std::endl;
+	std::cout << "  -w, --gc-window <integer>  Length of windows over which the GC content distribution of each" << std::endl;
+	std::cout << "                  model is recorded (see nb-classify --gc-tail). Set to 0 to not record" << std::endl;
+	std::cout << "                  (default = 100)." << std::endl;
+	std::cout << "  -k, --exact-index <file>  Also build an index of the exact k-mers found in each sequence file," << std::endl;
+	std::cout << "                  written to the given file (see nb-classify --exact-index)." << std::endl;
+	std::cout << "  -j, --exact-kmer-length <integer>  Length of k-mers in the exact k-mer index, up to 31" << std::endl;
+	std::cout << "                  (default = 31)." << std::endl;
+	std::cout << "  --sketches <file>   Also build a FracMinHash sketch of the 21-mers of each sequence file," << std::endl;
+	std::cout << "                  written to the given file (see nb-classify --sketches)." << std::endl;
+	std::cout << "  -z, --sketch-scale <integer>  Sketches retain about 1 in the given number of k-mers" << std::endl;
+	std::cout << "                  (default = 200)." << std::endl;
 	std::cout << std::endl;
 	std::cout << "Typical usage:" << std::endl;
 	std::cout << "  nb-train -s sequences.txt -m ./models/"  << std::endl << std::endl;
 }
 
+// true if the option at position p is followed by a value
+bool hasValue(int argc, char* argv[], int p)
+{
+	if(p + 1 < argc)
+		return true;
+
+	std::cout << "Missing value for parameter: " << argv[p] << std::endl << std::endl;
+	return false;
+}
+
+// true if the argument is the short or long name of an option
+bool isOption(const char* arg, const char* shortName, const char* longName)
+{
+	return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
+}
+
 bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 {
 	// set default values
@@ -59,6 +101,13 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 	parameters.bShowContactInfo = false;
 	parameters.bShowVersion = false;
 	parameters.kmerSize = 8;
+	parameters.bCanonical = false;
+	parameters.bSparse = false;
+	parameters.deltaThreshold = 1.0f;
+	parameters.prefilterKmerSize = 0;
+	parameters.gcWindowLength = 100;
+	parameters.exactKmerSize = ExactKmerIndex::DEFAULT_KMER_LENGTH;
+	parameters.sketchScale = SketchIndex::DEFAULT_SCALE;
 
 	// parse parameters
 	int p = 1;
@@ -66,16 +115,99 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 	{
 		if(strcmp(argv[p], "-n") == 0)
 		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
 			parameters.kmerSize = atoi(argv[p+1]);
 			p += 2;
 		}
+		else if(isOption(argv[p], "-c", "--canonical"))
+		{
+			parameters.bCanonical = true;
+			p += 1;
+		}
+		else if(isOption(argv[p], "-p", "--sparse"))
+		{
+			parameters.bSparse = true;
+			p += 1;
+		}
+		else if(isOption(argv[p], "-d", "--null-model"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.nullModelFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-x", "--delta-threshold"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.deltaThreshold = (float)atof(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-w", "--gc-window"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.gcWindowLength = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-k", "--exact-index"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.exactIndexFile = argv[p+1];
+			p += 2;
+		}
+		else if(strcmp(argv[p], "--sketches") == 0)
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.sketchFile = argv[p+1];
+			p += 2;
+		}
+		else if(isOption(argv[p], "-z", "--sketch-scale"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.sketchScale = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-j", "--exact-kmer-length"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.exactKmerSize = atoi(argv[p+1]);
+			p += 2;
+		}
+		else if(isOption(argv[p], "-f", "--prefilter-length"))
+		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
+			parameters.prefilterKmerSize = atoi(argv[p+1]);
+			p += 2;
+		}
 		else if(strcmp(argv[p], "-s") == 0)
 		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
 			parameters.sequenceFile = argv[p+1];
 			p += 2;
 		}
 		else if(strcmp(argv[p], "-m") == 0)
 		{
+			if(!hasValue(argc, argv, p))
+				return false;
+
 			parameters.outputDir = argv[p+1];
 			
 			char lastChar = parameters.outputDir[strlen(parameters.outputDir.c_str())-1];
@@ -84,7 +216,7 @@ bool parseCommandLine(int argc, char* argv[], Parameters& parameters)
 
 			p += 2;
 		}
-			else if(strcmp(argv[p], "--help") == 0)
+		else if(strcmp(argv[p], "--help") == 0 || strcmp(argv[p], "-h") == 0)
 		{
 			parameters.bShowHelp = true;
 			p += 1;
@@ -136,10 +268,84 @@ int main(int argc, char* argv[])
 		help();
 		return 0;
 	}
+	else if(parameters.kmerSize < 1 || parameters.kmerSize > (int)KmerCalculator::MAX_KMER_LENGTH)
+	{
+		std::cout << "N-mer length must be between 1 and " << KmerCalculator::MAX_KMER_LENGTH << "." << std::endl;
+		return -1;
+	}
+	else if(parameters.bCanonical && (parameters.bSparse || parameters.kmerSize > (int)KmerModel::MAX_DENSE_KMER_LENGTH))
+	{
+		std::cout << "Canonical n-mers are not supported by sparse models." << std::endl;
+		return -1;
+	}
+
+	else if(parameters.gcWindowLength < 0)
+	{
+		std::cout << "GC window length can not be negative." << std::endl;
+		return -1;
+	}
+	else if(parameters.exactKmerSize < 1 || parameters.exactKmerSize > (int)KmerCalculator::MAX_KMER_LENGTH)
+	{
+		std::cout << "Exact k-mer length must be between 1 and " << KmerCalculator::MAX_KMER_LENGTH << "." << std::endl;
+		return -1;
+	}
+	else if(parameters.sketchScale < 1)
+	{
+		std::cout << "Sketch scale must be at least 1." << std::endl;
+		return -1;
+	}
+	else if(parameters.prefilterKmerSize < 0 || parameters.prefilterKmerSize > (int)KmerModel::MAX_DENSE_KMER_LENGTH)
+	{
+		std::cout << "Prefilter n-mer length must be between 1 and " << KmerModel::MAX_DENSE_KMER_LENGTH << "." << std::endl;
+		return -1;
+	}
+	else if(!parameters.nullModelFile.empty() && (parameters.bCanonical || parameters.bSparse 
+						|| parameters.kmerSize > (int)KmerModel::MAX_DENSE_KMER_LENGTH))
+	{
+		std::cout << "Delta models can not be combined with canonical or sparse models." << std::endl;
+		return -1;
+	}
+
+	KmerModel::MODEL_FORMAT modelFormat = KmerModel::DENSE_MODEL;
+	if(parameters.bSparse || parameters.kmerSize > (int)KmerModel::MAX_DENSE_KMER_LENGTH)
+		modelFormat = KmerModel::SPARSE_MODEL;
+
+	// delta models are built relative to a dense null model with the same n-mer length
+	KmerModel* nullModel = NULL;
+	if(!parameters.nullModelFile.empty())
+	{
+		std::ifstream nullModelStream(parameters.nullModelFile.c_str(), std::ios::in | std::ios::binary);
+		if(nullModelStream.fail())
+		{
+			std::cerr << "Failed to open null model: " << parameters.nullModelFile << std::endl;
+			return -1;
+		}
+		nullModelStream.close();
+
+		nullModel = new KmerModel(parameters.nullModelFile);
+		if(!nullModel->valid() || nullModel->kmerLength() != (uint)parameters.kmerSize || nullModel->canonical() || nullModel->sparse() || nullModel->delta())
+		{
+			std::cerr << "Null model must be a dense model with an n-mer length of " << parameters.kmerSize << "." << std::endl;
+			delete nullModel;
+			return -1;
+		}
+	}
+
+	// the exact k-mer index holds the k-mers of all sequence files, with strains in the order of the sequence file
+	bool bExactIndex = !parameters.exactIndexFile.empty();
+	ExactKmerIndex exactIndex;
+	if(bExactIndex)
+		exactIndex.kmerLength(parameters.exactKmerSize);
+
+	bool bSketch = !parameters.sketchFile.empty();
+	SketchIndex sketchIndex;
+	if(bSketch)
+		sketchIndex.set(SketchIndex::DEFAULT_KMER_LENGTH, parameters.sketchScale);
 
 	// train model for each sequence in the sequence file
 	std::cout << "Training models..." << std::endl;
 	uint numModels = 0;
+	FastaIO fastaIO;	// read buffers are reused for all sequence files
 	std::ifstream modelStream(parameters.sequenceFile.c_str(), std::ios::in);
 	while(!modelStream.eof())
 	{
@@ -156,12 +362,23 @@ int main(int argc, char* argv[])
 
 		std::cout << "  Processing model " << modelName << std::endl;
 
-		KmerModel kmerModel(parameters.kmerSize);
+		KmerModel kmerModel(parameters.kmerSize, modelFormat);
 		kmerModel.name(modelName);
+		kmerModel.gcWindowLength(parameters.gcWindowLength);
+
+		KmerModel* prefilterModel = NULL;
+		if(parameters.prefilterKmerSize > 0)
+		{
+			prefilterModel = new KmerModel(parameters.prefilterKmerSize);
+			prefilterModel->name(modelName);
+		}
 
 		numModels++;		
-	
-		FastaIO fastaIO;
+
+		if(bExactIndex)
+			exactIndex.addStrain(modelName);
+		if(bSketch)
+			sketchIndex.addModel(modelName);
 		
 		bool bOK = fastaIO.open(line);
 		if(!bOK)
@@ -174,12 +391,24 @@ int main(int argc, char* argv[])
 		{
 			SeqInfo seqInfo;
 			bool bNextSeq = fastaIO.nextSeq(seqInfo);
+			if(!bNextSeq && fastaIO.error())
+			{
+				std::cerr << "Error reading file: " << line << std::endl;
+				return -1;
+			}
+
 			if(!bNextSeq)
 				break;
 
 			seqInfo.taxonomy.strain = modelName;
 
 			bOK = kmerModel.constructModel(seqInfo);
+			if(bOK && prefilterModel != NULL)
+				bOK = prefilterModel->constructModel(seqInfo);
+			if(bOK && bExactIndex)
+				exactIndex.add(seqInfo);
+			if(bOK && bSketch)
+				sketchIndex.add(seqInfo);
 			if(!bOK)
 			{
 				std::cerr << "Error building model." << std::endl;
@@ -188,11 +417,52 @@ int main(int argc, char* argv[])
 		}	
 
 		kmerModel.calculateConditionalProbabilities();
+		if(parameters.bCanonical && !kmerModel.makeCanonical())
+		{
+			std::cerr << "Canonical n-mers are not supported for this encoding." << std::endl;
+			return -1;
+		}
+
+		if(nullModel != NULL)
+		{
+			kmerModel.makeDelta(*nullModel, parameters.deltaThreshold);
+			std::cout << "    Retained " << kmerModel.numDeltas() << " of " << (1ULL << (2*parameters.kmerSize)) << " n-mers." << std::endl;
+		}
+
 		kmerModel.write(parameters.outputDir + modelName + ".txt");
+
+		if(prefilterModel != NULL)
+		{
+			prefilterModel->calculateConditionalProbabilities();
+			prefilterModel->write(parameters.outputDir + modelName + ".prefilter");
+			delete prefilterModel;
+		}
+	}
+
+	delete nullModel;
+
+	if(bExactIndex)
+	{
+		std::cout << "  Building exact k-mer index" << std::endl;
+		exactIndex.build();
+		exactIndex.write(parameters.exactIndexFile);
+	}
+
+	if(bSketch)
+	{
+		sketchIndex.build();
+		sketchIndex.write(parameters.sketchFile);
 	}
 
 	std::cout << std::endl;
 	std::cout << "Number of models: " << numModels << std::endl;
+	if(bExactIndex)
+	{
+		std::cout << "Number of exact k-mers: " << exactIndex.numKmers() << std::endl;
+		std::cout << "Number of distinct strain sets: " << exactIndex.numStrainSets() << std::endl;
+	}
+	if(bSketch)
+		std::cout << "Number of distinct sketch hashes: " << sketchIndex.numHashes() << std::endl;
 
 	return 0;
 }
@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+###############################################################################
+#                                                                             #
+#    This program is free software: you can redistribute it and/or modify     #
+#    it under the terms of the GNU General Public License as published by     #
+#    the Free Software Foundation, either version 3 of the License, or        #
+#    (at your option) any later version.                                      #
+#                                                                             #
+#    This program is distributed in the hope that it will be useful,          #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of           #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            #
+#    GNU General Public License for more details.                             #
+#                                                                             #
+#    You should have received a copy of the GNU General Public License        #
+#    along with this program. If not, see <http://www.gnu.org/licenses/>.     #
+#                                                                             #
+###############################################################################
+
+# Report recall of a prefilter cascade for different numbers of candidates.
+
+from __future__ import print_function
+
+import sys
+
+if len(sys.argv) < 3:
+	print('CascadeReport v1.0')
+	print('')
+	print('Usage: python CascadeReport.py <nb-results> <prefilter-results> [candidates]')
+	print('')
+	print('Required parameters:')
+	print('  <nb-results>         Results of NB classifier with T=0.')
+	print('  <prefilter-results>  Results of NB classifier with T=0 using the prefilter models.')
+	print('')
+	print('Optional parameters:')
+	print('  [candidates]         Comma separated numbers of candidates C (default = 1,2,5,10,20,50).')
+	print('')
+	print('Recall at C is the fraction of fragments where the top model reported by the')
+	print('NB classifier is among the C models with highest prefilter log likelihood.')
+	print('')
+	print('Typical usage:')
+	print('  nb-classify -q query.fna -m models.txt -r nb_results.txt')
+	print('  nb-classify -q query.fna -m prefilter_models.txt -r prefilter_results.txt')
+	print('  python CascadeReport.py nb_results.txt prefilter_results.txt 5,10,20')
+	print('')
+	sys.exit()
+
+nbResults = sys.argv[1]
+prefilterResults = sys.argv[2]
+candidates = [1, 2, 5, 10, 20, 50]
+if len(sys.argv) > 3:
+	candidates = [int(c) for c in sys.argv[3].split(',')]
+
+nbFile = open(nbResults)
+prefilterFile = open(prefilterResults)
+
+nbHeader = nbFile.readline().rstrip('\n').split('\t')[3:]
+prefilterHeader = prefilterFile.readline().rstrip('\n').split('\t')[3:]
+if nbHeader != prefilterHeader:
+	print('[Error] Models must be listed in the same order in both results files.')
+	sys.exit()
+
+numFragments = 0
+hits = [0]*len(candidates)
+for nbLine, prefilterLine in zip(nbFile, prefilterFile):
+	nbSplit = nbLine.rstrip('\n').split('\t')
+	prefilterSplit = prefilterLine.rstrip('\n').split('\t')
+	if nbSplit[0] != prefilterSplit[0]:
+		print('[Error] Fragments must be listed in the same order in both results files.')
+		sys.exit()
+
+	nbLogLikelihoods = [float(x) for x in nbSplit[3:]]
+	prefilterLogLikelihoods = [float(x) for x in prefilterSplit[3:]]
+
+	topModel = max(range(len(nbLogLikelihoods)), key = lambda i: nbLogLikelihoods[i])
+	prefilterRank = sorted(range(len(prefilterLogLikelihoods)), key = lambda i: -prefilterLogLikelihoods[i]).index(topModel)
+
+	for i, c in enumerate(candidates):
+		if prefilterRank < c:
+			hits[i] += 1
+	numFragments += 1
+
+print('Number of fragments: %d' % numFragments)
+print('Candidates\tRecall')
+for i, c in enumerate(candidates):
+	print('%d\t%.4f' % (c, float(hits[i]) / max(numFragments, 1)))
@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+###############################################################################
+#                                                                             #
+#    This program is free software: you can redistribute it and/or modify     #
+#    it under the terms of the GNU General Public License as published by     #
+#    the Free Software Foundation, either version 3 of the License, or        #
+#    (at your option) any later version.                                      #
+#                                                                             #
+#    This program is distributed in the hope that it will be useful,          #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of           #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            #
+#    GNU General Public License for more details.                             #
+#                                                                             #
+#    You should have received a copy of the GNU General Public License        #
+#    along with this program. If not, see <http://www.gnu.org/licenses/>.     #
+#                                                                             #
+###############################################################################
+
+# Report accuracy and throughput of delta models relative to dense models.
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import subprocess
+
+if len(sys.argv) < 6:
+	print('DeltaReport v1.0')
+	print('')
+	print('Usage: python DeltaReport.py <sequence-file> <null-model> <query-file> <n-mer length> <work-dir> [thresholds]')
+	print('')
+	print('Required parameters:')
+	print('  <sequence-file>  File listing path to each FASTA file for which a model should be built.')
+	print('  <null-model>     Null model built with nb-null-model using the same n-mer length.')
+	print('  <query-file>     Held-out query fragments used to compare dense and delta models.')
+	print('  <n-mer length>   Oligonucleotide length of all models.')
+	print('  <work-dir>       Directory to store models and classification results.')
+	print('')
+	print('Optional parameters:')
+	print('  [thresholds]     Comma separated delta model thresholds (default = 0.5,1.0,1.5,2.0).')
+	print('')
+	print('Typical usage:')
+	print('  python DeltaReport.py sequences.txt null_model.txt held_out.fna 10 ./delta_report/')
+	print('')
+	sys.exit()
+
+sequenceFile = sys.argv[1]
+nullModel = sys.argv[2]
+queryFile = sys.argv[3]
+kmerLength = sys.argv[4]
+workDir = sys.argv[5]
+thresholds = [0.5, 1.0, 1.5, 2.0]
+if len(sys.argv) > 6:
+	thresholds = [float(t) for t in sys.argv[6].split(',')]
+
+def trainModels(modelDir, extraArgs):
+	if not os.path.exists(modelDir):
+		os.makedirs(modelDir)
+	subprocess.check_call(['nb-train', '-n', kmerLength, '-s', sequenceFile, '-m', modelDir] + extraArgs, stdout = open(os.devnull, 'w'))
+
+	modelFiles = []
+	for line in open(sequenceFile):
+		line = line.strip()
+		if line == '':
+			continue
+		modelName = os.path.splitext(os.path.basename(line))[0]
+		modelFiles.append(os.path.join(modelDir, modelName + '.txt'))
+
+	modelList = os.path.join(modelDir, 'models.txt')
+	fout = open(modelList, 'w')
+	for modelFile in modelFiles:
+		fout.write(modelFile + '\n')
+	fout.close()
+
+	modelBytes = sum([os.path.getsize(f) for f in modelFiles])
+	return modelList, modelBytes
+
+def classify(modelList, resultsFile, extraArgs):
+	startTime = time.time()
+	subprocess.check_call(['nb-classify', '-q', queryFile, '-m', modelList, '-r', resultsFile, '-v', '0'] + extraArgs)
+	return time.time() - startTime
+
+def readResults(resultsFile):
+	logLikelihoods = []
+	bHeaderLine = True
+	for line in open(resultsFile):
+		if bHeaderLine:
+			bHeaderLine = False
+			continue
+		lineSplit = line.rstrip('\n').split('\t')
+		logLikelihoods.append([float(x) for x in lineSplit[3:]])
+	return logLikelihoods
+
+def topModel(values):
+	return max(range(len(values)), key = lambda i: values[i])
+
+# classification with dense models gives the reference log likelihoods
+denseList, denseBytes = trainModels(os.path.join(workDir, 'dense'), [])
+denseResults = os.path.join(workDir, 'dense_results.txt')
+denseTime = classify(denseList, denseResults, [])
+denseLogLikelihoods = readResults(denseResults)
+
+print('Threshold\tModel bytes\tClassify (s)\tTop model agreement\tMean |LL error|\tMax |LL error|')
+print('dense\t%d\t%.2f\t1.0000\t0.000\t0.000' % (denseBytes, denseTime))
+
+for threshold in thresholds:
+	modelDir = os.path.join(workDir, 'delta_%g' % threshold)
+	deltaList, deltaBytes = trainModels(modelDir, ['-d', nullModel, '-x', str(threshold)])
+	deltaResults = os.path.join(workDir, 'delta_%g_results.txt' % threshold)
+	deltaTime = classify(deltaList, deltaResults, ['-n', nullModel])
+	deltaLogLikelihoods = readResults(deltaResults)
+
+	numAgree = 0
+	sumError = 0.0
+	maxError = 0.0
+	numValues = 0
+	for dense, delta in zip(denseLogLikelihoods, deltaLogLikelihoods):
+		if topModel(dense) == topModel(delta):
+			numAgree += 1
+		for d, e in zip(dense, delta):
+			error = abs(d - e)
+			sumError += error
+			maxError = max(maxError, error)
+			numValues += 1
+
+	print('%g\t%d\t%.2f\t%.4f\t%.3f\t%.3f' % (threshold, deltaBytes, deltaTime, float(numAgree) / max(len(denseLogLikelihoods), 1), 
+														sumError / max(numValues, 1), maxError))